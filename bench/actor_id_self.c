@@ -0,0 +1,85 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* One actor for every thread of the pool calls actor_id_self() CALLS times,
+ * all of them at once. Messages are the calls. A call is too short to be
+ * timed alone, so no latencies are recorded, ns_per_call is the average
+ * time of a call over all callers.
+ */
+
+#define CALLS 1000000
+
+#define MSG_DONE (message_type_t)0x1
+
+static size_t number_of_callers, finished;
+static atomic_uint_fast64_t total_ns;
+static act caller_prompts[1];
+static role_t caller_role = {1, caller_prompts, 0};
+
+// Calls actor_id_self() in a loop and reports to the parent.
+void caller_hello(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) nbytes;
+  actor_id_t parent = *(actor_id_t *) data;
+  actor_id_t sum = 0;
+  uint64_t start, elapsed;
+
+  start = bench_now_ns();
+  for (long i = 0; i < CALLS; i++)
+    sum += actor_id_self();
+  elapsed = bench_now_ns() - start;
+
+  if (sum != actor_id_self() * CALLS)
+    exit(EXIT_FAILURE);
+
+  atomic_fetch_add(&total_ns, elapsed);
+
+  message_t done = {MSG_DONE, 0, NULL};
+  send_message(parent, done);
+
+  message_t godie = {MSG_GODIE, 0, NULL};
+  send_message(actor_id_self(), godie);
+}
+
+void parent_hello(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) nbytes;
+  (void) data;
+
+  for (size_t i = 0; i < number_of_callers; i++) {
+    message_t spawn = {MSG_SPAWN, sizeof(role_t), &caller_role};
+    send_message(actor_id_self(), spawn);
+  }
+}
+
+void parent_done(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) nbytes;
+  (void) data;
+
+  if (++finished == number_of_callers) {
+    message_t godie = {MSG_GODIE, 0, NULL};
+    send_message(actor_id_self(), godie);
+  }
+}
+
+static void run(size_t pool_size) {
+  act parent_prompts[2] = {parent_hello, parent_done};
+  role_t parent_role = {2, parent_prompts, 0};
+  char extra[64];
+  uint64_t elapsed;
+
+  caller_prompts[0] = caller_hello;
+  number_of_callers = pool_size;
+
+  elapsed = bench_run_system(&parent_role, pool_size, 0);
+
+  snprintf(extra, sizeof(extra), ", \"ns_per_call\": %.2f",
+           (double) atomic_load(&total_ns) / ((double) CALLS * number_of_callers));
+  bench_report("actor_id_self", pool_size, (uint64_t) CALLS * number_of_callers, elapsed, extra);
+}
+
+int main(int argc, char **argv) {
+  return bench_sweep(argc, argv, run);
+}
@@ -0,0 +1,122 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// At most that many latencies are kept for percentiles, later ones are dropped.
+#define BENCH_MAX_SAMPLES ((size_t) 1 << 22)
+
+static uint64_t *all_samples;
+static atomic_size_t number_of_all_samples;
+
+void bench_add_samples(const uint64_t *samples, size_t n) {
+  size_t begin = atomic_fetch_add(&number_of_all_samples, n);
+
+  for (size_t i = 0; i < n && begin + i < BENCH_MAX_SAMPLES; i++)
+    all_samples[begin + i] = samples[i];
+}
+
+void bench_reset() {
+  atomic_store(&number_of_all_samples, 0);
+}
+
+void bench_flush(bench_samples_t *local) {
+  bench_add_samples(local->samples, local->number_of_samples);
+  local->number_of_samples = 0;
+}
+
+void bench_record(bench_samples_t *local, uint64_t latency_ns) {
+  local->samples[local->number_of_samples++] = latency_ns;
+
+  if (local->number_of_samples == BENCH_LOCAL_SAMPLES)
+    bench_flush(local);
+}
+
+static int compare_samples(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+  return (x > y) - (x < y);
+}
+
+void bench_report(const char *name, size_t pool_size, uint64_t messages, uint64_t elapsed_ns,
+                  const char *extra) {
+  size_t n = atomic_load(&number_of_all_samples);
+  uint64_t p50 = 0, p99 = 0;
+  struct rusage usage;
+  double seconds = (double) elapsed_ns / 1e9;
+
+  if (n > BENCH_MAX_SAMPLES)
+    n = BENCH_MAX_SAMPLES;
+
+  if (n > 0) {
+    qsort(all_samples, n, sizeof(uint64_t), compare_samples);
+    p50 = all_samples[n / 2];
+    p99 = all_samples[n * 99 / 100];
+  }
+
+  getrusage(RUSAGE_SELF, &usage);
+
+  printf("{\"bench\": \"%s\", \"pool_size\": %zu, \"messages\": %lu, \"seconds\": %.6f, "
+         "\"msgs_per_sec\": %.1f, \"p50_ns\": %lu, \"p99_ns\": %lu, \"samples\": %zu, "
+         "\"peak_rss_kb\": %ld%s}\n",
+         name, pool_size, (unsigned long) messages, seconds, (double) messages / seconds,
+         (unsigned long) p50, (unsigned long) p99, n, usage.ru_maxrss, extra != NULL ? extra : "");
+  fflush(stdout);
+}
+
+uint64_t bench_run_system(role_t *role, size_t pool_size, size_t actor_queue_limit) {
+  cacti_config_t config = {.pool_size = pool_size, .actor_queue_limit = actor_queue_limit,
+                           .buffer_sends = (getenv("BENCH_BUFFER_SENDS") != NULL)};
+  actor_id_t first;
+  uint64_t start = bench_now_ns();
+
+  if (actor_system_create_ex(&first, role, &config) != 0) {
+    fprintf(stderr, "actor_system_create_ex failed\n");
+    exit(EXIT_FAILURE);
+  }
+  actor_system_join(first);
+
+  return bench_now_ns() - start;
+}
+
+int bench_sweep(int argc, char **argv, void (*run)(size_t pool_size)) {
+  static const size_t default_pool_sizes[] = {1, 2, 4, 8};
+  size_t number_of_runs = (argc > 1 ? (size_t) argc - 1 : sizeof(default_pool_sizes) / sizeof(size_t));
+  int status, result = EXIT_SUCCESS;
+  pid_t pid;
+
+  for (size_t i = 0; i < number_of_runs; i++) {
+    size_t pool_size = (argc > 1 ? strtoul(argv[i + 1], NULL, 10) : default_pool_sizes[i]);
+
+    if (pool_size == 0) {
+      fprintf(stderr, "usage: %s [pool size]...\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+    // A process per run, so peak RSS is not inherited from previous runs.
+    if ((pid = fork()) == -1) {
+      perror("fork");
+      return EXIT_FAILURE;
+    }
+
+    if (pid == 0) {
+      if ((all_samples = malloc(BENCH_MAX_SAMPLES * sizeof(uint64_t))) == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+      }
+      run(pool_size);
+      free(all_samples);
+      exit(EXIT_SUCCESS);
+    }
+
+    if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "run with pool size %zu failed\n", pool_size);
+      result = EXIT_FAILURE;
+    }
+  }
+
+  return result;
+}
@@ -0,0 +1,64 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "cacti.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Helpers shared by the benchmarks. Every benchmark runs once per pool size
+ * given on the command line (by default 1, 2, 4 and 8 threads), each run in
+ * its own process, and prints one JSON object per run on stdout:
+ *
+ * {"bench": "ping_pong", "pool_size": 2, "messages": 200000,
+ *  "seconds": 0.41, "msgs_per_sec": 487804.9, "p50_ns": 1900,
+ *  "p99_ns": 7300, "samples": 100000, "peak_rss_kb": 3400}
+ */
+
+typedef void (*act)(void **stateptr, size_t nbytes, void *data);
+
+// Number of latencies an actor keeps before copying them to the common array.
+#define BENCH_LOCAL_SAMPLES 256
+
+// Latencies recorded by one actor.
+typedef struct bench_samples {
+  uint64_t samples[BENCH_LOCAL_SAMPLES];
+  size_t number_of_samples;
+} bench_samples_t;
+
+static inline uint64_t bench_now_ns() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Records a latency, copies the actor`s latencies to the common array when full.
+void bench_record(bench_samples_t *local, uint64_t latency_ns);
+
+// Copies the actor`s latencies to the common array.
+void bench_flush(bench_samples_t *local);
+
+// Copies n latencies to the common array.
+void bench_add_samples(const uint64_t *samples, size_t n);
+
+// Drops all latencies, so that one process can report more than one run.
+void bench_reset();
+
+/* Prints the result of a run, counting percentiles over all recorded
+ * latencies. Extra, if not NULL, is appended to the object as is, it has to
+ * start with a comma.
+ */
+void bench_report(const char *name, size_t pool_size, uint64_t messages, uint64_t elapsed_ns,
+                  const char *extra);
+
+// Runs run(pool_size) in a new process for every pool size from argv.
+int bench_sweep(int argc, char **argv, void (*run)(size_t pool_size));
+
+/* Creates a system of pool_size threads, waits for it and returns the time
+ * it took. Sends are buffered if BENCH_BUFFER_SENDS is set in the environment.
+ */
+uint64_t bench_run_system(role_t *role, size_t pool_size, size_t actor_queue_limit);
+
+#endif
@@ -0,0 +1,150 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* One actor sends ROUNDS payloads of PAYLOAD_SIZE bytes to each of
+ * NUMBER_OF_ACTORS receivers, first shared by all of them with
+ * broadcast_message_shared, then copied for every receiver with
+ * send_message_copy. Peak RSS of the process is reported, so the shared
+ * run comes first. The next round starts when every receiver has
+ * got the previous one. Latency is the time from starting a round to
+ * a receiver getting its payload.
+ */
+
+#define NUMBER_OF_ACTORS 1000
+#define ROUNDS 16
+#define PAYLOAD_SIZE (64 * 1024)
+
+#define MSG_WORK (message_type_t)0x1
+#define MSG_DONE (message_type_t)0x1
+
+typedef struct receiver_state {
+  bench_samples_t latencies;
+  long received;
+} receiver_state_t;
+
+static bool is_shared;
+static actor_id_t sender;
+static actor_id_t receivers[NUMBER_OF_ACTORS];
+static long number_of_done, rounds;
+static uint64_t round_start_ns;
+static unsigned char *buffer;
+static act receiver_prompts[2];
+static role_t receiver_role = {2, receiver_prompts, 0};
+
+void receiver_hello(void **stateptr, size_t nbytes, void *data) {
+  (void) nbytes;
+  (void) data;
+  receiver_state_t *state;
+
+  if ((state = calloc(1, sizeof(receiver_state_t))) == NULL)
+    exit(EXIT_FAILURE);
+  *stateptr = state;
+}
+
+void receiver_work(void **stateptr, size_t nbytes, void *data) {
+  receiver_state_t *state = *stateptr;
+  const unsigned char *payload = data;
+
+  bench_record(&state->latencies, bench_now_ns() - round_start_ns);
+
+  // The payload is read, as a receiver would.
+  if (nbytes != PAYLOAD_SIZE || payload[0] != payload[nbytes - 1])
+    exit(EXIT_FAILURE);
+
+  message_t done = {MSG_DONE, 0, NULL};
+  send_message(sender, done);
+
+  if (++state->received == ROUNDS) {
+    bench_flush(&state->latencies);
+    free(state);
+    *stateptr = NULL;
+
+    message_t godie = {MSG_GODIE, 0, NULL};
+    send_message(actor_id_self(), godie);
+  }
+}
+
+static void send_round() {
+  round_start_ns = bench_now_ns();
+
+  if (is_shared) {
+    unsigned char *data = cacti_alloc_shared(PAYLOAD_SIZE);
+    message_t work = {MSG_WORK, PAYLOAD_SIZE, data};
+
+    memset(data, (int) rounds, PAYLOAD_SIZE);
+    if (broadcast_message_shared(receivers, NUMBER_OF_ACTORS, work, NULL) != NUMBER_OF_ACTORS)
+      exit(EXIT_FAILURE);
+    cacti_free_shared(data);
+  } else {
+    memset(buffer, (int) rounds, PAYLOAD_SIZE);
+    for (int i = 0; i < NUMBER_OF_ACTORS; i++) {
+      if (send_message_copy(receivers[i], MSG_WORK, buffer, PAYLOAD_SIZE) != 0)
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  rounds++;
+}
+
+void sender_hello(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) nbytes;
+  (void) data;
+
+  sender = actor_id_self();
+
+  // MSG_HELLO of the receivers is before the first round in their queues.
+  if (spawn_actors(&receiver_role, NUMBER_OF_ACTORS, receivers) != NUMBER_OF_ACTORS)
+    exit(EXIT_FAILURE);
+  send_round();
+}
+
+void sender_done(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) nbytes;
+  (void) data;
+
+  if (++number_of_done % NUMBER_OF_ACTORS != 0)
+    return;
+
+  if (rounds < ROUNDS) {
+    send_round();
+  } else {
+    message_t godie = {MSG_GODIE, 0, NULL};
+    send_message(sender, godie);
+  }
+}
+
+static void run(size_t pool_size) {
+  act sender_prompts[2] = {sender_hello, sender_done};
+  role_t sender_role = {2, sender_prompts, 0};
+  char extra[64];
+  uint64_t elapsed;
+
+  receiver_prompts[0] = receiver_hello;
+  receiver_prompts[1] = receiver_work;
+
+  if ((buffer = malloc(PAYLOAD_SIZE)) == NULL)
+    exit(EXIT_FAILURE);
+  snprintf(extra, sizeof(extra), ", \"payload_bytes\": %d", PAYLOAD_SIZE);
+
+  for (int shared = 1; shared >= 0; shared--) {
+    is_shared = shared;
+    number_of_done = 0;
+    rounds = 0;
+    bench_reset();
+
+    // The sender gets MSG_DONE from all receivers of a round while still receiving the last one of the previous.
+    elapsed = bench_run_system(&sender_role, pool_size, NUMBER_OF_ACTORS + 1);
+    bench_report(is_shared ? "broadcast_shared" : "broadcast_copy", pool_size,
+                 (uint64_t) NUMBER_OF_ACTORS * ROUNDS, elapsed, extra);
+  }
+
+  free(buffer);
+}
+
+int main(int argc, char **argv) {
+  return bench_sweep(argc, argv, run);
+}
@@ -0,0 +1,118 @@
+#include "bench.h"
+#include <stdlib.h>
+
+/* NUMBER_OF_ACTORS senders send MESSAGES_PER_ACTOR messages each to one
+ * receiver, BATCH_SIZE in one turn. Latency is the time from sending a
+ * message to receiving it.
+ */
+
+#define NUMBER_OF_ACTORS 64
+#define MESSAGES_PER_ACTOR 8192
+#define BATCH_SIZE 32
+
+#define MSG_READY (message_type_t)0x1
+#define MSG_WORK (message_type_t)0x2
+#define MSG_SEND (message_type_t)0x1
+
+static actor_id_t receiver;
+static actor_id_t senders[NUMBER_OF_ACTORS];
+static long number_of_senders, received;
+static bench_samples_t latencies;
+static act sender_prompts[2];
+static role_t sender_role = {2, sender_prompts, 0};
+
+void sender_hello(void **stateptr, size_t nbytes, void *data) {
+  (void) nbytes;
+  (void) data;
+  long *sent;
+
+  if ((sent = calloc(1, sizeof(long))) == NULL)
+    exit(EXIT_FAILURE);
+  *stateptr = sent;
+
+  message_t ready = {MSG_READY, (size_t) actor_id_self(), NULL};
+  send_message(receiver, ready);
+}
+
+// Sends as much of the next batch as fits, then lets others run before sending more.
+void sender_send(void **stateptr, size_t nbytes, void *data) {
+  (void) nbytes;
+  (void) data;
+  long *sent = *stateptr;
+  message_t batch[BATCH_SIZE];
+  size_t n = (MESSAGES_PER_ACTOR - *sent < BATCH_SIZE ? MESSAGES_PER_ACTOR - *sent : BATCH_SIZE);
+  long result;
+
+  for (size_t i = 0; i < n; i++)
+    batch[i] = (message_t) {MSG_WORK, (size_t) bench_now_ns(), NULL};
+
+  // The receiver is alive until all messages arrive, so only a full queue stops them.
+  if ((result = send_messages(receiver, batch, n)) > 0)
+    *sent += result;
+
+  if (*sent < MESSAGES_PER_ACTOR) {
+    message_t send = {MSG_SEND, 0, NULL};
+    send_message(actor_id_self(), send);
+  } else {
+    free(sent);
+    *stateptr = NULL;
+
+    message_t godie = {MSG_GODIE, 0, NULL};
+    send_message(actor_id_self(), godie);
+  }
+}
+
+void receiver_hello(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) nbytes;
+  (void) data;
+
+  receiver = actor_id_self();
+
+  for (int i = 0; i < NUMBER_OF_ACTORS; i++) {
+    message_t spawn = {MSG_SPAWN, sizeof(role_t), &sender_role};
+    send_message(receiver, spawn);
+  }
+}
+
+void receiver_ready(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) data;
+
+  senders[number_of_senders++] = (actor_id_t) nbytes;
+
+  if (number_of_senders == NUMBER_OF_ACTORS) {
+    message_t send = {MSG_SEND, 0, NULL};
+    broadcast_message(senders, NUMBER_OF_ACTORS, send, NULL);
+  }
+}
+
+void receiver_work(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) data;
+
+  bench_record(&latencies, bench_now_ns() - (uint64_t) nbytes);
+
+  if (++received == (long) NUMBER_OF_ACTORS * MESSAGES_PER_ACTOR) {
+    bench_flush(&latencies);
+
+    message_t godie = {MSG_GODIE, 0, NULL};
+    send_message(receiver, godie);
+  }
+}
+
+static void run(size_t pool_size) {
+  act receiver_prompts[3] = {receiver_hello, receiver_ready, receiver_work};
+  role_t receiver_role = {3, receiver_prompts, 0};
+
+  sender_prompts[0] = sender_hello;
+  sender_prompts[1] = sender_send;
+
+  // The receiver can fall behind by all messages, senders do not have to back off.
+  uint64_t elapsed = bench_run_system(&receiver_role, pool_size, (size_t) NUMBER_OF_ACTORS * MESSAGES_PER_ACTOR);
+  bench_report("fan_in", pool_size, (uint64_t) NUMBER_OF_ACTORS * MESSAGES_PER_ACTOR, elapsed, NULL);
+}
+
+int main(int argc, char **argv) {
+  return bench_sweep(argc, argv, run);
+}
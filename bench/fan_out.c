@@ -0,0 +1,133 @@
+#include "bench.h"
+#include <stdlib.h>
+
+/* One actor sends MESSAGES_PER_ACTOR messages to each of NUMBER_OF_ACTORS
+ * receivers, BATCH_SIZE to each in one turn. Latency is the time from
+ * sending a message to receiving it.
+ */
+
+#define NUMBER_OF_ACTORS 64
+#define MESSAGES_PER_ACTOR 8192 // Multiple of BATCH_SIZE.
+#define BATCH_SIZE 32
+
+#define MSG_READY (message_type_t)0x1
+#define MSG_ROUND (message_type_t)0x2
+#define MSG_DONE (message_type_t)0x3
+#define MSG_WORK (message_type_t)0x1
+
+typedef struct receiver_state {
+  bench_samples_t latencies;
+  long received;
+} receiver_state_t;
+
+static actor_id_t sender;
+static actor_id_t receivers[NUMBER_OF_ACTORS];
+static long number_of_receivers, number_of_done, sent;
+static act receiver_prompts[2];
+static role_t receiver_role = {2, receiver_prompts, 0};
+
+void receiver_hello(void **stateptr, size_t nbytes, void *data) {
+  (void) nbytes;
+  (void) data;
+  receiver_state_t *state;
+
+  if ((state = calloc(1, sizeof(receiver_state_t))) == NULL)
+    exit(EXIT_FAILURE);
+  *stateptr = state;
+
+  message_t ready = {MSG_READY, (size_t) actor_id_self(), NULL};
+  send_message(sender, ready);
+}
+
+void receiver_work(void **stateptr, size_t nbytes, void *data) {
+  (void) data;
+  receiver_state_t *state = *stateptr;
+
+  bench_record(&state->latencies, bench_now_ns() - (uint64_t) nbytes);
+
+  if (++state->received == MESSAGES_PER_ACTOR) {
+    bench_flush(&state->latencies);
+    free(state);
+    *stateptr = NULL;
+
+    message_t done = {MSG_DONE, 0, NULL};
+    send_message(sender, done);
+
+    message_t godie = {MSG_GODIE, 0, NULL};
+    send_message(actor_id_self(), godie);
+  }
+}
+
+void sender_hello(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) nbytes;
+  (void) data;
+
+  sender = actor_id_self();
+
+  for (int i = 0; i < NUMBER_OF_ACTORS; i++) {
+    message_t spawn = {MSG_SPAWN, sizeof(role_t), &receiver_role};
+    send_message(sender, spawn);
+  }
+}
+
+void sender_ready(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) data;
+
+  receivers[number_of_receivers++] = (actor_id_t) nbytes;
+
+  if (number_of_receivers == NUMBER_OF_ACTORS) {
+    message_t round = {MSG_ROUND, 0, NULL};
+    send_message(sender, round);
+  }
+}
+
+// Sends the next batch to every receiver, the round message lets others run in between.
+void sender_round(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) nbytes;
+  (void) data;
+  message_t batch[BATCH_SIZE];
+
+  for (int i = 0; i < NUMBER_OF_ACTORS; i++) {
+    for (int j = 0; j < BATCH_SIZE; j++)
+      batch[j] = (message_t) {MSG_WORK, (size_t) bench_now_ns(), NULL};
+
+    if (send_messages(receivers[i], batch, BATCH_SIZE) != BATCH_SIZE)
+      exit(EXIT_FAILURE);
+  }
+
+  sent += BATCH_SIZE;
+  if (sent < MESSAGES_PER_ACTOR) {
+    message_t round = {MSG_ROUND, 0, NULL};
+    send_message(sender, round);
+  }
+}
+
+void sender_done(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) nbytes;
+  (void) data;
+
+  if (++number_of_done == NUMBER_OF_ACTORS) {
+    message_t godie = {MSG_GODIE, 0, NULL};
+    send_message(sender, godie);
+  }
+}
+
+static void run(size_t pool_size) {
+  act sender_prompts[4] = {sender_hello, sender_ready, sender_round, sender_done};
+  role_t sender_role = {4, sender_prompts, 0};
+
+  receiver_prompts[0] = receiver_hello;
+  receiver_prompts[1] = receiver_work;
+
+  // Receivers can fall behind by all their messages, none is rejected.
+  uint64_t elapsed = bench_run_system(&sender_role, pool_size, MESSAGES_PER_ACTOR);
+  bench_report("fan_out", pool_size, (uint64_t) NUMBER_OF_ACTORS * MESSAGES_PER_ACTOR, elapsed, NULL);
+}
+
+int main(int argc, char **argv) {
+  return bench_sweep(argc, argv, run);
+}
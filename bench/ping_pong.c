@@ -0,0 +1,89 @@
+#include "bench.h"
+
+// Two actors pass one message back and forth, latency is the round trip time.
+
+#define ROUNDS 100000
+
+#define MSG_READY (message_type_t)0x1
+#define MSG_PING (message_type_t)0x1
+#define MSG_PONG (message_type_t)0x2
+
+static actor_id_t pinger, ponger;
+static long rounds;
+static bench_samples_t round_trips;
+static act ponger_prompts[2];
+static role_t ponger_role = {2, ponger_prompts, 0};
+
+static void send_ping() {
+  message_t ping = {MSG_PING, (size_t) bench_now_ns(), NULL};
+  send_message(ponger, ping);
+}
+
+void ponger_hello(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) nbytes;
+  (void) data;
+
+  message_t ready = {MSG_READY, (size_t) actor_id_self(), NULL};
+  send_message(pinger, ready);
+}
+
+// The time of sending the ping comes back with the pong.
+void ponger_ping(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) data;
+
+  message_t pong = {MSG_PONG, nbytes, NULL};
+  send_message(pinger, pong);
+}
+
+void pinger_hello(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) nbytes;
+  (void) data;
+
+  pinger = actor_id_self();
+
+  message_t spawn = {MSG_SPAWN, sizeof(role_t), &ponger_role};
+  send_message(pinger, spawn);
+}
+
+void pinger_ready(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) data;
+
+  ponger = (actor_id_t) nbytes;
+  send_ping();
+}
+
+void pinger_pong(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) data;
+
+  bench_record(&round_trips, bench_now_ns() - (uint64_t) nbytes);
+
+  if (++rounds < ROUNDS) {
+    send_ping();
+  } else {
+    bench_flush(&round_trips);
+
+    message_t godie = {MSG_GODIE, 0, NULL};
+    send_message(ponger, godie);
+    send_message(pinger, godie);
+  }
+}
+
+static void run(size_t pool_size) {
+  act pinger_prompts[3] = {pinger_hello, pinger_ready, pinger_pong};
+  role_t pinger_role = {3, pinger_prompts, 0};
+
+  ponger_prompts[0] = ponger_hello;
+  ponger_prompts[1] = ponger_ping;
+
+  uint64_t elapsed = bench_run_system(&pinger_role, pool_size, 0);
+  bench_report("ping_pong", pool_size, 2 * ROUNDS, elapsed, NULL);
+}
+
+int main(int argc, char **argv) {
+  return bench_sweep(argc, argv, run);
+}
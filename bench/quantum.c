@@ -0,0 +1,126 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* NUMBER_OF_ACTORS actors keep sending messages to themselves, once for
+ * every quantum set with actor_system_set_quantum. Fairness is Jain`s
+ * index of messages received by the actors when the first of them has
+ * received FAIRNESS_POINT, 1 if all have got as far. Latency is the time
+ * from sending a message to receiving it.
+ */
+
+#define NUMBER_OF_ACTORS 64
+#define MESSAGES_PER_ACTOR 20000
+#define FAIRNESS_POINT 512
+
+#define MSG_PING (message_type_t)0x1
+
+static const size_t quanta[] = {1, 4, 8, 32, 128};
+
+typedef struct pinger_state {
+  bench_samples_t latencies;
+  long index;
+  long received;
+} pinger_state_t;
+
+static atomic_long progress[NUMBER_OF_ACTORS];
+static atomic_long number_of_started;
+static atomic_bool is_fairness_counted;
+static double fairness;
+static act pinger_prompts[2];
+static role_t pinger_role = {2, pinger_prompts, 0};
+
+static void send_ping() {
+  message_t ping = {MSG_PING, (size_t) bench_now_ns(), NULL};
+  send_message(actor_id_self(), ping);
+}
+
+// Counts Jain`s index of the actors` progress.
+static void count_fairness() {
+  double sum = 0, sum_of_squares = 0, x;
+
+  for (int i = 0; i < NUMBER_OF_ACTORS; i++) {
+    x = (double) atomic_load_explicit(&progress[i], memory_order_relaxed);
+    sum += x;
+    sum_of_squares += x * x;
+  }
+
+  fairness = sum * sum / (NUMBER_OF_ACTORS * sum_of_squares);
+}
+
+void pinger_hello(void **stateptr, size_t nbytes, void *data) {
+  (void) nbytes;
+  (void) data;
+  pinger_state_t *state;
+
+  if ((state = calloc(1, sizeof(pinger_state_t))) == NULL)
+    exit(EXIT_FAILURE);
+  state->index = atomic_fetch_add(&number_of_started, 1);
+  *stateptr = state;
+
+  send_ping();
+}
+
+void pinger_ping(void **stateptr, size_t nbytes, void *data) {
+  (void) data;
+  pinger_state_t *state = *stateptr;
+
+  bench_record(&state->latencies, bench_now_ns() - (uint64_t) nbytes);
+  atomic_store_explicit(&progress[state->index], ++state->received, memory_order_relaxed);
+
+  if (state->received == FAIRNESS_POINT && !atomic_exchange(&is_fairness_counted, true))
+    count_fairness();
+
+  if (state->received < MESSAGES_PER_ACTOR) {
+    send_ping();
+    return;
+  }
+
+  bench_flush(&state->latencies);
+  free(state);
+  *stateptr = NULL;
+
+  message_t godie = {MSG_GODIE, 0, NULL};
+  send_message(actor_id_self(), godie);
+}
+
+void spawner_hello(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) nbytes;
+  (void) data;
+  actor_id_t pingers[NUMBER_OF_ACTORS];
+
+  if (spawn_actors(&pinger_role, NUMBER_OF_ACTORS, pingers) != NUMBER_OF_ACTORS)
+    exit(EXIT_FAILURE);
+
+  message_t godie = {MSG_GODIE, 0, NULL};
+  send_message(actor_id_self(), godie);
+}
+
+static void run(size_t pool_size) {
+  act spawner_prompts[1] = {spawner_hello};
+  role_t spawner_role = {1, spawner_prompts, 0};
+  char extra[64];
+  uint64_t elapsed;
+
+  pinger_prompts[0] = pinger_hello;
+  pinger_prompts[1] = pinger_ping;
+
+  for (size_t i = 0; i < sizeof(quanta) / sizeof(size_t); i++) {
+    for (int j = 0; j < NUMBER_OF_ACTORS; j++)
+      atomic_store(&progress[j], 0);
+    atomic_store(&number_of_started, 0);
+    atomic_store(&is_fairness_counted, false);
+    bench_reset();
+
+    actor_system_set_quantum(quanta[i], 0);
+    elapsed = bench_run_system(&spawner_role, pool_size, 0);
+
+    snprintf(extra, sizeof(extra), ", \"quantum\": %zu, \"fairness\": %.3f", quanta[i], fairness);
+    bench_report("quantum", pool_size, (uint64_t) NUMBER_OF_ACTORS * MESSAGES_PER_ACTOR, elapsed, extra);
+  }
+}
+
+int main(int argc, char **argv) {
+  return bench_sweep(argc, argv, run);
+}
@@ -0,0 +1,94 @@
+#include "bench.h"
+#include <stdlib.h>
+
+/* One actor spawns NUMBER_OF_ACTORS children, first with a MSG_SPAWN each,
+ * at most URGENT_QUEUE_LIMIT of them waiting in his urgent lane, then with
+ * one spawn_actors call. Every child reports to the parent and dies.
+ * Latency is the time from starting to spawn to a child receiving MSG_HELLO.
+ */
+
+#define NUMBER_OF_ACTORS 100000
+
+#define MSG_READY (message_type_t)0x1
+
+static bool is_bulk;
+static uint64_t spawn_ns;
+static long number_of_ready, number_of_spawns;
+static actor_id_t children[NUMBER_OF_ACTORS];
+static act child_prompts[1];
+static role_t child_role = {1, child_prompts, 0};
+
+// Data points to the parent`s id.
+void child_hello(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) nbytes;
+  uint64_t latency = bench_now_ns() - spawn_ns;
+
+  bench_add_samples(&latency, 1);
+
+  message_t ready = {MSG_READY, 0, NULL};
+  send_message(*(actor_id_t *) data, ready);
+
+  message_t godie = {MSG_GODIE, 0, NULL};
+  send_message(actor_id_self(), godie);
+}
+
+// Sends himself the next MSG_SPAWN, if any is left.
+static void spawn_next() {
+  message_t spawn = {MSG_SPAWN, sizeof(role_t), &child_role};
+
+  if (number_of_spawns < NUMBER_OF_ACTORS && send_message(actor_id_self(), spawn) == 0)
+    number_of_spawns++;
+}
+
+void parent_hello(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) nbytes;
+  (void) data;
+
+  spawn_ns = bench_now_ns();
+  if (is_bulk) {
+    if (spawn_actors(&child_role, NUMBER_OF_ACTORS, children) != NUMBER_OF_ACTORS)
+      exit(EXIT_FAILURE);
+  } else {
+    for (int i = 0; i < URGENT_QUEUE_LIMIT; i++)
+      spawn_next();
+  }
+}
+
+void parent_ready(void **stateptr, size_t nbytes, void *data) {
+  (void) stateptr;
+  (void) nbytes;
+  (void) data;
+
+  if (!is_bulk)
+    spawn_next();
+
+  if (++number_of_ready == NUMBER_OF_ACTORS) {
+    message_t godie = {MSG_GODIE, 0, NULL};
+    send_message(actor_id_self(), godie);
+  }
+}
+
+static void run(size_t pool_size) {
+  act parent_prompts[2] = {parent_hello, parent_ready};
+  role_t parent_role = {2, parent_prompts, 0};
+  uint64_t elapsed;
+
+  child_prompts[0] = child_hello;
+
+  // MSG_SPAWN, MSG_HELLO, ready and MSG_GODIE for every child.
+  for (int bulk = 0; bulk <= 1; bulk++) {
+    is_bulk = bulk;
+    number_of_ready = number_of_spawns = 0;
+    bench_reset();
+
+    elapsed = bench_run_system(&parent_role, pool_size, 2 * NUMBER_OF_ACTORS);
+    bench_report(is_bulk ? "spawn_flat_bulk" : "spawn_flat", pool_size, 4 * (uint64_t) NUMBER_OF_ACTORS, elapsed,
+                 NULL);
+  }
+}
+
+int main(int argc, char **argv) {
+  return bench_sweep(argc, argv, run);
+}
@@ -0,0 +1,129 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Every actor above DEPTH spawns FANOUT children with MSG_SPAWN, leaves
+ * report back and die, then their parents do. Latency is the time from
+ * sending MSG_SPAWN to the child receiving MSG_HELLO.
+ */
+
+#define FANOUT 4
+#define DEPTH 8
+
+#define MSG_GROW (message_type_t)0x1
+#define MSG_READY (message_type_t)0x2
+#define MSG_DONE (message_type_t)0x3
+
+typedef struct node_state {
+  actor_id_t parent;
+  uint64_t hello_ns; // Read by the parent after MSG_READY.
+  uint64_t spawn_ns;
+  uint64_t spawn_latencies[FANOUT];
+  size_t depth;
+  long ready; // Children that have received MSG_HELLO.
+  long pending; // Children that have not finished yet.
+} node_state_t;
+
+static act node_prompts[4];
+static role_t node_role = {4, node_prompts, 0};
+
+// The first actor gets no parent with MSG_HELLO.
+void node_hello(void **stateptr, size_t nbytes, void *data) {
+  (void) nbytes;
+  node_state_t *state;
+
+  if ((state = calloc(1, sizeof(node_state_t))) == NULL)
+    exit(EXIT_FAILURE);
+  state->hello_ns = bench_now_ns();
+  *stateptr = state;
+
+  if (data == NULL) {
+    state->parent = ACTOR_ID_NONE;
+
+    message_t grow = {MSG_GROW, 0, NULL};
+    send_message(actor_id_self(), grow);
+  } else {
+    state->parent = *(actor_id_t *) data;
+
+    message_t ready = {MSG_READY, (size_t) actor_id_self(), &state->hello_ns};
+    send_message(state->parent, ready);
+  }
+}
+
+static void finish(void **stateptr) {
+  node_state_t *state = *stateptr;
+
+  bench_add_samples(state->spawn_latencies, state->ready);
+
+  if (state->parent != ACTOR_ID_NONE) {
+    message_t done = {MSG_DONE, 0, NULL};
+    send_message(state->parent, done);
+  }
+
+  free(state);
+  *stateptr = NULL;
+
+  message_t godie = {MSG_GODIE, 0, NULL};
+  send_message(actor_id_self(), godie);
+}
+
+// Nbytes is the depth of the actor.
+void node_grow(void **stateptr, size_t nbytes, void *data) {
+  (void) data;
+  node_state_t *state = *stateptr;
+
+  state->depth = nbytes;
+  if (state->depth == DEPTH) {
+    finish(stateptr);
+    return;
+  }
+
+  state->spawn_ns = bench_now_ns();
+  state->pending = FANOUT;
+  for (int i = 0; i < FANOUT; i++) {
+    message_t spawn = {MSG_SPAWN, sizeof(role_t), &node_role};
+    send_message(actor_id_self(), spawn);
+  }
+}
+
+// Nbytes is the child`s id, data points to the time he got MSG_HELLO.
+void node_ready(void **stateptr, size_t nbytes, void *data) {
+  node_state_t *state = *stateptr;
+
+  state->spawn_latencies[state->ready++] = *(uint64_t *) data - state->spawn_ns;
+
+  message_t grow = {MSG_GROW, state->depth + 1, NULL};
+  send_message((actor_id_t) nbytes, grow);
+}
+
+void node_done(void **stateptr, size_t nbytes, void *data) {
+  (void) nbytes;
+  (void) data;
+  node_state_t *state = *stateptr;
+
+  if (--state->pending == 0)
+    finish(stateptr);
+}
+
+static void run(size_t pool_size) {
+  uint64_t number_of_actors = 0, level = 1;
+  char extra[64];
+
+  for (int i = 0; i <= DEPTH; i++, level *= FANOUT)
+    number_of_actors += level;
+
+  node_prompts[0] = node_hello;
+  node_prompts[1] = node_grow;
+  node_prompts[2] = node_ready;
+  node_prompts[3] = node_done;
+
+  uint64_t elapsed = bench_run_system(&node_role, pool_size, 0);
+
+  // MSG_SPAWN, MSG_HELLO, ready, grow, done and MSG_GODIE for all but the first actor.
+  snprintf(extra, sizeof(extra), ", \"actors\": %lu", (unsigned long) number_of_actors);
+  bench_report("spawn_tree", pool_size, 6 * (number_of_actors - 1) + 3, elapsed, extra);
+}
+
+int main(int argc, char **argv) {
+  return bench_sweep(argc, argv, run);
+}
@@ -1,41 +1,70 @@
+#define _GNU_SOURCE
 #include "global.h"
 #include "cacti_aux.h"
+#include <sched.h>
+#include <limits.h>
+#include <string.h>
 
+/* Returns id of the actor whose message is being received by the current
+ * thread, ACTOR_ID_NONE if the thread is not receiving any message.
+ */
 actor_id_t actor_id_self() {
-  int err;
-  pthread_t thread_id = pthread_self();
-  actor_id_t actor_id_aux;
-  // Acquiring access to global data.
-  if ((err = pthread_mutex_lock(&mutex)) != 0)
-    handle_error_en(err, "pthread_mutex_lock");
-
-  for (uint32_t i = 0; i < POOL_SIZE; i++) {
-    if (th[i] == thread_id) {
-      actor_id_aux = performing_actor[i];
-      break;
-    }
-  }
-
-  if ((err = pthread_mutex_unlock(&mutex)) != 0)
-    handle_error_en(err, "pthread_mutex_unlock");
-
-  return actor_id_aux;
+  return performing_actor;
 }
 
 // Creates a brand new actor system.
 int actor_system_create(actor_id_t *actor, role_t *const role) {
+  cacti_config_t config = {.pool_size = POOL_SIZE};
+
+  return actor_system_create_ex(actor, role, &config);
+}
+
+// Creates a brand new actor system set up at run time.
+int actor_system_create_ex(actor_id_t *actor, role_t *const role, const cacti_config_t *config) {
+  cacti_config_t default_config = {0};
+  cpu_set_t cpus;
+  int err;
+
   if (actor == NULL || role == NULL)
     return SYSTEM_CREATION_ERROR;
 
-  int err;
-  initialize();
+  if (config == NULL)
+    config = &default_config;
+
+  /* Checking the config before anything is created. MSG_GODIE may move
+   * from the urgent lane to the normal one, so both limits fit there.
+   */
+  if (config->pool_size >= BLOCKING_THREAD_NUMBER ||
+      config->actor_queue_limit > LANE_MASK[LANE_NORMAL] - LANE_MASK[LANE_URGENT] ||
+      config->urgent_queue_limit > LANE_MASK[LANE_URGENT] ||
+      config->cast_limit > (uint64_t) 1 << ACTOR_INDEX_BITS)
+    return SYSTEM_CREATION_ERROR;
+  if (config->stack_size > 0 && config->stack_size < (size_t) PTHREAD_STACK_MIN)
+    return SYSTEM_CREATION_ERROR;
+  if (config->cpus != NULL) {
+    // Threads can run only on CPUs the process is allowed to use, otherwise creating them would fail.
+    if (config->number_of_cpus == 0 || sched_getaffinity(0, sizeof(cpu_set_t), &cpus) != 0)
+      return SYSTEM_CREATION_ERROR;
+    for (size_t i = 0; i < config->number_of_cpus; i++)
+      if (config->cpus[i] < 0 || config->cpus[i] >= CPU_SETSIZE || !CPU_ISSET(config->cpus[i], &cpus))
+        return SYSTEM_CREATION_ERROR;
+  }
+
+  initialize(config);
 
-  actors[0].id = 0;
-  actors[0].role = role;
-  *actor = actors[0].id;
+  initialize_actor(0, 0, role);
+  *actor = get_actor(0)->id;
 
   uint32_t *thread_number;
-  for (uint32_t i = 0; i < POOL_SIZE; i++) {
+  for (uint32_t i = 0; i < pool_size; i++) {
+    if (config->cpus != NULL) {
+      // Attributes are copied by pthread_create, so they can be changed for every thread.
+      CPU_ZERO(&cpus);
+      CPU_SET(config->cpus[i % config->number_of_cpus], &cpus);
+      if ((err = pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpus)) != 0)
+        handle_error_en(err, "pthread_attr_setaffinity_np");
+    }
+
     check_alloc_validity(thread_number = malloc(sizeof(uint32_t)));
     *thread_number = i;
     if ((err = pthread_create(&th[i], &attr, thread_task, thread_number)) != 0)
@@ -43,7 +72,7 @@ int actor_system_create(actor_id_t *actor, role_t *const role) {
   }
 
   message_t aux = {MSG_HELLO, sizeof(NULL), NULL};
-  send_message(actors[0].id, aux);
+  send_message(get_actor(0)->id, aux);
 
   return SYSTEM_CREATION_SUCCESS;
 }
@@ -51,63 +80,468 @@ int actor_system_create(actor_id_t *actor, role_t *const role) {
 void actor_system_join(actor_id_t actor) {
   int err;
 
-  if (actor >= (int64_t) number_of_actors)
+  if (!is_actor_id_valid(actor))
     exit(1);
 
-  for (uint32_t i = 0; i < POOL_SIZE; i++)
+  for (uint32_t i = 0; i < pool_size; i++)
     if ((err = pthread_join(th[i], 0)) != 0)
       handle_error_en(err, "pthread_join");
+  join_blocking_threads();
+  join_timer_thread();
+  // Broadcasts of the joining thread have left their scratch.
+  free_thread_scratch();
 
+  write_trace();
   clean_system_memory();
 }
 
+void actor_system_set_quantum(size_t messages, unsigned long time_budget_us) {
+  // At least one message has to be received, otherwise the actor would never progress.
+  atomic_store(&throughput_quantum, messages > 0 ? messages : 1);
+  atomic_store(&quantum_time_budget, (uint64_t) time_budget_us * 1000);
+}
+
+void actor_system_set_idle_policy(size_t spins, size_t yields) {
+  atomic_store(&idle_spins, spins);
+  atomic_store(&idle_yields, yields);
+}
+
+static long send_messages_to_lane(actor_id_t actor, message_t *messages, size_t n, message_lane_t lane,
+                                  bool may_change_lane) {
+  uint64_t number_of_messages;
+  message_node *first, *last;
+  long places;
+
+  if (!is_actor_id_valid(actor))
+    return ACTOR_ID_INCORRECT;
+
+  if (n == 0)
+    return 0;
+
+  actor = route_message(actor, NULL);
+  places = reserve_places_in_buffer(actor, n, &lane, may_change_lane, &number_of_messages);
+  if (places < 0)
+    return places;
+
+  make_message_nodes(messages, places, &first, &last);
+
+  if (post_message_nodes(actor, lane, first, last, (size_t) places, number_of_messages)) {
+    // The actor is neither waiting in any queue nor being processed.
+    add_actor_to_thread_queue(actor);
+  }
+
+  return places;
+}
+
 int send_message(actor_id_t actor, message_t message) {
-  int err;
-  bool is_actor_dead, is_queue_full, is_id_incorrect;
+  // Control messages never wait behind data, a full urgent lane is an error.
+  long sent = send_messages_to_lane(actor, &message, 1, get_message_lane(message.message_type), false);
 
-  if ((err = pthread_mutex_lock(&mutex)) != 0)
-    handle_error_en(err, "pthread_mutex_lock");
+  return (sent < 0 ? (int) sent : SEND_MESSAGE_SUCCESS);
+}
 
-  is_id_incorrect = (actor >= (int64_t) number_of_actors);
+int send_message_to_lane(actor_id_t actor, message_t message, message_lane_t lane) {
+  // Anything but the urgent lane means the normal one.
+  long sent = send_messages_to_lane(actor, &message, 1, lane == LANE_URGENT ? LANE_URGENT : LANE_NORMAL, true);
 
-  if ((err = pthread_mutex_unlock(&mutex)) != 0)
-    handle_error_en(err, "pthread_mutex_unlock");
+  return (sent < 0 ? (int) sent : SEND_MESSAGE_SUCCESS);
+}
+
+long send_messages(actor_id_t actor, message_t *messages, size_t n) {
+  return send_messages_to_lane(actor, messages, n, LANE_NORMAL, false);
+}
+
+int send_message_with_key(actor_id_t actor, message_t message, unsigned long key) {
+  uint64_t routing_key = key;
 
-  if (is_id_incorrect)
+  if (!is_actor_id_valid(actor))
     return ACTOR_ID_INCORRECT;
 
-  // Obtaining exclusive access to the actor info.
-  if ((err = pthread_mutex_lock(&actors[actor].lock)) != 0)
-    handle_error_en(err, "pthread_mutex_lock");
+  return send_message(route_message(actor, &routing_key), message);
+}
 
-  is_actor_dead = actors[actor].is_actor_dead;
-  is_queue_full = actors[actor].msg_q.number_of_messages == ACTOR_QUEUE_LIMIT;
+int send_message_copy(actor_id_t actor, message_type_t message_type, const void *data, size_t nbytes) {
+  message_lane_t lane = get_message_lane(message_type);
+  uint64_t number_of_messages;
+  message_node *node;
+  long places;
 
-  if (!is_actor_dead) {
-    if (actors[actor].msg_q.number_of_messages < ACTOR_QUEUE_LIMIT) {
-      actors[actor].msg_q.number_of_messages++;
-      actors[actor].msg_q.messages[actors[actor].msg_q.writepos] = message;
-      actors[actor].msg_q.writepos = (actors[actor].msg_q.writepos + 1) % ACTOR_QUEUE_LIMIT;
+  if (!is_actor_id_valid(actor))
+    return ACTOR_ID_INCORRECT;
 
-      if (actors[actor].msg_q.number_of_messages == 1) {
-        add_actor_to_thread_queue(actor);
-      }
-    }
+  actor = route_message(actor, NULL);
+  places = reserve_places_in_buffer(actor, 1, &lane, false, &number_of_messages);
+  if (places < 0)
+    return (int) places;
+
+  node = allocate_message_node();
+  node->message.message_type = message_type;
+  node->message.nbytes = nbytes;
+  if (nbytes <= MESSAGE_INLINE_SIZE) {
+    node->payload = PAYLOAD_INLINE;
+    node->message.data = node->inline_data;
+  } else {
+    node->payload = PAYLOAD_OWNED;
+    node->message.data = allocate_payload(nbytes);
   }
+  if (nbytes > 0)
+    memcpy(node->message.data, data, nbytes);
 
-  if ((err = pthread_mutex_unlock(&actors[actor].lock)) != 0)
-    handle_error_en(err, "pthread_mutex_unlock");
+  if (post_message_nodes(actor, lane, node, node, 1, number_of_messages)) {
+    // The actor is neither waiting in any queue nor being processed.
+    add_actor_to_thread_queue(actor);
+  }
+
+  return SEND_MESSAGE_SUCCESS;
+}
+
+long spawn_actors(role_t *role, size_t n, actor_id_t *out) {
+  uint64_t spawned;
+
+  // Actors are spawned only by living actors, see update_state_of_the_system.
+  if (actor_id_self() == ACTOR_ID_NONE || role == NULL || (out == NULL && n > 0))
+    return ACTOR_ID_INCORRECT;
+
+  if (n == 0)
+    return 0;
+
+  spawned = create_new_actors(out, n, actor_id_self(), role);
+  if (spawned > 0)
+    add_actors_to_thread_queues(out, spawned);
 
-  if (is_actor_dead)
+  return (long) spawned;
+}
+
+long spawn_router(role_t *role, size_t n, router_strategy_t strategy, actor_id_t *members, actor_id_t *router_id) {
+  router *new_router;
+  uint64_t spawned;
+
+  if (actor_id_self() == ACTOR_ID_NONE || role == NULL || router_id == NULL || n == 0 ||
+      strategy > ROUTER_LEAST_LOADED)
+    return ACTOR_ID_INCORRECT;
+
+  // The router`s place comes first, members are never left without it.
+  if ((new_router = create_router(strategy, n, role)) == NULL)
+    return 0;
+
+  spawned = create_new_actors(new_router->members, n, actor_id_self(), role);
+  set_router_members(new_router, spawned);
+
+  if (members != NULL)
+    memcpy(members, new_router->members, spawned * sizeof(actor_id_t));
+  *router_id = new_router->id;
+
+  if (spawned > 0)
+    add_actors_to_thread_queues(new_router->members, spawned);
+  release_router(new_router);
+
+  return (long) spawned;
+}
+
+// Returns the error code a message sent to the actor, not to a router, would get now.
+static int check_actor(actor_id_t actor) {
+  uint64_t number_of_messages = atomic_load(&get_actor(actor)->msg_q.number_of_messages);
+
+  if ((number_of_messages & ACTOR_DEAD_FLAG) || number_of_messages >> GENERATION_SHIFT != get_actor_generation(actor))
     return ACTOR_IS_DEAD;
 
-  if (is_queue_full)
-    return ACTOR_QUEUE_IS_FULL;
+  return SEND_MESSAGE_SUCCESS;
+}
+
+/* Checks that a message can be sent to the actor now, returns the error
+ * code send_message would return. Messages to a router are routed when
+ * they are sent, so a router is alive while any of its members is.
+ */
+static int check_receiver(actor_id_t actor) {
+  router *r;
+  int result = ACTOR_IS_DEAD;
+
+  if (!is_actor_id_valid(actor))
+    return ACTOR_ID_INCORRECT;
+
+  if ((r = get_router(actor)) == NULL)
+    return check_actor(actor);
+
+  for (uint64_t i = 0; i < r->number_of_members && result != SEND_MESSAGE_SUCCESS; i++)
+    result = check_actor(r->members[i]);
+  release_router(r);
+
+  return result;
+}
+
+timer_id_t send_message_after(actor_id_t actor, message_t message, unsigned long delay_us) {
+  int result = check_receiver(actor);
+
+  if (result != SEND_MESSAGE_SUCCESS)
+    return result;
+
+  return add_timer(actor, message, (uint64_t) delay_us * 1000, 0);
+}
+
+timer_id_t send_message_every(actor_id_t actor, message_t message, unsigned long delay_us,
+                              unsigned long period_us) {
+  int result = check_receiver(actor);
+
+  if (result != SEND_MESSAGE_SUCCESS)
+    return result;
+
+  // A zero period would make a one-shot timer, it is a tick instead.
+  return add_timer(actor, message, (uint64_t) delay_us * 1000, period_us > 0 ? (uint64_t) period_us * 1000 : 1);
+}
+
+int cancel_timer(timer_id_t timer) {
+  return (remove_timer(timer) ? 0 : -1);
+}
+
+// Sends the message as a request through a new slot, returns its handle or an error code.
+static request_id_t send_request_from(actor_id_t requester, actor_id_t actor, message_t message,
+                                      message_type_t reply_type) {
+  cacti_request_t *request;
+  request_id_t id;
+  int result;
+
+  if (!is_actor_id_valid(actor))
+    return ACTOR_ID_INCORRECT;
+
+  request = open_request(requester, reply_type, message);
+  // Once sent, the request can be replied and its slot reused at any time.
+  id = request->reply_to;
+  message.nbytes = sizeof(cacti_request_t);
+  message.data = request;
+
+  if ((result = send_message(actor, message)) != SEND_MESSAGE_SUCCESS) {
+    cancel_request(id);
+    return result;
+  }
+
+  return id;
+}
+
+int send_request(actor_id_t actor, message_t message, message_type_t reply_type) {
+  request_id_t request;
+
+  if (actor_id_self() == ACTOR_ID_NONE)
+    return ACTOR_ID_INCORRECT;
+
+  request = send_request_from(actor_id_self(), actor, message, reply_type);
+
+  return (request < 0 ? (int) request : SEND_MESSAGE_SUCCESS);
+}
+
+request_id_t send_request_future(actor_id_t actor, message_t message) {
+  return send_request_from(ACTOR_ID_NONE, actor, message, 0);
+}
+
+int wait_for_reply(request_id_t request, message_t *reply) {
+  if (reply == NULL)
+    return -1;
+
+  return (wait_for_request(request, reply) ? 0 : -1);
+}
+
+int send_reply(request_id_t reply_to, size_t nbytes, void *data) {
+  return (complete_request(reply_to, nbytes, data) ? 0 : -1);
+}
+
+void *cacti_alloc(size_t nbytes) {
+  return allocate_payload(nbytes);
+}
+
+void cacti_free(void *data) {
+  if (data != NULL)
+    release_payload(data);
+}
+
+void *cacti_alloc_shared(size_t nbytes) {
+  return allocate_shared_payload(nbytes);
+}
+
+void cacti_retain_shared(void *data) {
+  if (data != NULL)
+    retain_shared_payload(data, 1);
+}
+
+void cacti_free_shared(void *data) {
+  if (data != NULL)
+    release_shared_payload(data, 1);
+}
+
+int send_message_shared(actor_id_t actor, message_t message) {
+  message_lane_t lane = get_message_lane(message.message_type);
+  uint64_t number_of_messages;
+  message_node *node;
+  long places;
+
+  if (!is_actor_id_valid(actor))
+    return ACTOR_ID_INCORRECT;
+
+  actor = route_message(actor, NULL);
+  places = reserve_places_in_buffer(actor, 1, &lane, false, &number_of_messages);
+  if (places < 0)
+    return (int) places;
 
+  // The reference is taken before the receiver can see the message.
+  retain_shared_payload(message.data, 1);
+  make_message_nodes(&message, 1, &node, &node);
+  node->payload = PAYLOAD_SHARED;
+
+  if (post_message_nodes(actor, lane, node, node, 1, number_of_messages)) {
+    // The actor is neither waiting in any queue nor being processed.
+    add_actor_to_thread_queue(actor);
+  }
 
   return SEND_MESSAGE_SUCCESS;
 }
 
+// Sends the message to each of n actors, its data being of the given kind.
+static long broadcast_message_of(const actor_id_t *actors, size_t n, message_t message, int *results,
+                                 enum payload_kinds payload) {
+  uint64_t number_of_messages, number_of_runnable = 0;
+  message_lane_t lane;
+  actor_id_t *runnable, receiver;
+  message_node *node;
+  long sent = 0, places;
+
+  if (n == 0)
+    return 0;
+
+  // Actors which become runnable are made so at the end, grouped by threads.
+  runnable = get_runnable_scratch(n);
+
+  // References for all actors are taken before any of them can see the message.
+  if (payload == PAYLOAD_SHARED)
+    retain_shared_payload(message.data, n);
+
+  for (size_t i = 0; i < n; i++) {
+    if (!is_actor_id_valid(actors[i])) {
+      places = ACTOR_ID_INCORRECT;
+    } else {
+      receiver = route_message(actors[i], NULL);
+      lane = get_message_lane(message.message_type);
+      places = reserve_places_in_buffer(receiver, 1, &lane, false, &number_of_messages);
+      if (places > 0) {
+        make_message_nodes(&message, 1, &node, &node);
+        node->payload = payload;
+        sent++;
+
+        if (post_message_nodes(receiver, lane, node, node, 1, number_of_messages))
+          runnable[number_of_runnable++] = receiver;
+      }
+    }
+
+    if (results != NULL)
+      results[i] = (places < 0 ? (int) places : SEND_MESSAGE_SUCCESS);
+  }
 
+  if (number_of_runnable > 0)
+    add_actors_to_thread_queues(runnable, number_of_runnable);
 
+  // The caller still holds a reference, so these are never the last ones.
+  if (payload == PAYLOAD_SHARED && (size_t) sent < n)
+    release_shared_payload(message.data, n - sent);
+
+  return sent;
+}
+
+long broadcast_message(const actor_id_t *actors, size_t n, message_t message, int *results) {
+  return broadcast_message_of(actors, n, message, results, PAYLOAD_POINTER);
+}
+
+long broadcast_message_shared(const actor_id_t *actors, size_t n, message_t message, int *results) {
+  return broadcast_message_of(actors, n, message, results, PAYLOAD_SHARED);
+}
+
+#if CACTI_STATS
+// Reads a counter of a thread, written concurrently by that thread.
+static uint64_t load_stat(uint32_t thread_number, enum stat_counters counter) {
+  return atomic_load_explicit(&stats_of_threads[thread_number].counters[counter], memory_order_relaxed);
+}
+#endif
+
+int cacti_get_stats(cacti_stats_t *stats) {
+#if CACTI_STATS
+  int err;
+  uint64_t counters[NUMBER_OF_STAT_COUNTERS] = {0}, value, actors_count;
+  size_t number_of_workers;
 
+  if (stats == NULL || stats_of_threads == NULL)
+    return -1;
+
+  for (uint32_t i = 0; i <= pool_size; i++)
+    for (int j = 0; j < NUMBER_OF_STAT_COUNTERS; j++)
+      counters[j] += load_stat(i, j);
+
+  number_of_workers = (stats->workers == NULL ? 0 : stats->number_of_workers);
+  for (uint32_t i = 0; i < pool_size && i < number_of_workers; i++) {
+    stats->workers[i].messages = load_stat(i, STAT_MESSAGES);
+    stats->workers[i].handler_ns = load_stat(i, STAT_HANDLER_NS);
+    stats->workers[i].idle_ns = load_stat(i, STAT_IDLE_NS);
+    stats->workers[i].steals = load_stat(i, STAT_STEALS);
+
+    if ((err = pthread_mutex_lock(&actor_q[i].lock)) != 0)
+      handle_error_en(err, "pthread_mutex_lock");
+
+    stats->workers[i].queue_length = actor_q[i].number_of_actors;
+    stats->workers[i].queue_high_water = actor_q[i].high_water;
+
+    if ((err = pthread_mutex_unlock(&actor_q[i].lock)) != 0)
+      handle_error_en(err, "pthread_mutex_unlock");
+  }
+
+  stats->pool_size = pool_size;
+  stats->messages = counters[STAT_MESSAGES];
+  stats->sent = counters[STAT_SENT];
+  stats->queue_full = counters[STAT_QUEUE_FULL];
+  stats->actor_dead = counters[STAT_ACTOR_DEAD];
+  stats->spawns = counters[STAT_SPAWNS];
+
+  // Reclaimed actors have left their marks, the living ones are looked through.
+  if ((err = pthread_mutex_lock(&mutex)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  stats->mailbox_high_water = finished_actors_high_water;
+  actors_count = atomic_load(&number_of_actors);
+
+  if ((err = pthread_mutex_unlock(&mutex)) != 0)
+    handle_error_en(err, "pthread_mutex_unlock");
+
+  /* Segments of the table stay in place, so the scan does not hold up
+   * spawning and reclaiming actors.
+   */
+  for (uint64_t i = 0; i < actors_count; i++) {
+    value = atomic_load_explicit(&get_actor(i)->queue_high_water, memory_order_relaxed);
+    if (value > stats->mailbox_high_water)
+      stats->mailbox_high_water = value;
+  }
+
+  return 0;
+#else
+  (void) stats;
+  return -1;
+#endif
+}
+
+int cacti_get_actor_stats(actor_id_t actor, cacti_actor_stats_t *stats) {
+#if CACTI_STATS
+  actor_info *info;
+  uint64_t number_of_messages;
+
+  if (stats == NULL || !is_actor_id_valid(actor))
+    return -1;
+
+  info = get_actor(actor);
+  number_of_messages = atomic_load(&info->msg_q.number_of_messages);
+  if (number_of_messages >> GENERATION_SHIFT != get_actor_generation(actor))
+    return -1;
+
+  stats->messages = atomic_load_explicit(&info->messages_received, memory_order_relaxed);
+  stats->queue_length = count_messages(number_of_messages);
+  stats->queue_high_water = atomic_load_explicit(&info->queue_high_water, memory_order_relaxed);
+
+  return 0;
+#else
+  (void) actor;
+  (void) stats;
+  return -1;
+#endif
+}
@@ -13,6 +13,11 @@ typedef long message_type_t;
 #define ACTOR_QUEUE_LIMIT 1024
 #endif
 
+// Messages an actor can have waiting in the urgent lane, at most 255.
+#ifndef URGENT_QUEUE_LIMIT
+#define URGENT_QUEUE_LIMIT 64
+#endif
+
 #ifndef CAST_LIMIT
 #define CAST_LIMIT 1048576
 #endif
@@ -21,27 +26,358 @@ typedef long message_type_t;
 #define POOL_SIZE 3
 #endif
 
+// Most threads running actors with ROLE_BLOCKING.
+#ifndef BLOCKING_POOL_LIMIT
+#define BLOCKING_POOL_LIMIT 64
+#endif
+
+// Threads for actors with ROLE_BLOCKING that stay when idle, once started.
+#ifndef BLOCKING_POOL_MIN
+#define BLOCKING_POOL_MIN 1
+#endif
+
+// Microseconds a thread for actors with ROLE_BLOCKING waits idle before it ends.
+#ifndef BLOCKING_IDLE_TIMEOUT_US
+#define BLOCKING_IDLE_TIMEOUT_US 1000000
+#endif
+
+/* Times in a row (roughly) that an actor has to be made runnable by one
+ * other thread before he moves to that thread, 0 to never move actors.
+ */
+#ifndef MIGRATION_VOTES
+#define MIGRATION_VOTES 16
+#endif
+
+// Actors a thread has waiting at least, so that an actor stolen from it moves to the thief.
+#ifndef MIGRATION_QUEUE_LENGTH
+#define MIGRATION_QUEUE_LENGTH 4
+#endif
+
+#ifndef THROUGHPUT_QUANTUM
+#define THROUGHPUT_QUANTUM 8
+#endif
+
+// Payloads up to that many bytes are copied into the message itself.
+#ifndef MESSAGE_INLINE_SIZE
+#define MESSAGE_INLINE_SIZE 48
+#endif
+
+#ifndef IDLE_SPINS
+#define IDLE_SPINS 1024
+#endif
+
+#ifndef IDLE_YIELDS
+#define IDLE_YIELDS 16
+#endif
+
+// Length of a tick of timers in microseconds, delays are rounded up to whole ticks.
+#ifndef TIMER_TICK_US
+#define TIMER_TICK_US 1000
+#endif
+
+// Set to 0 to compile out collection of statistics.
+#ifndef CACTI_STATS
+#define CACTI_STATS 1
+#endif
+
+// Set to 1 to compile in tracing, enabled with cacti_config_t.trace_path.
+#ifndef CACTI_TRACE
+#define CACTI_TRACE 0
+#endif
+
+// Number of latest trace events kept by every thread.
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE 65536
+#endif
+
 typedef struct message {
   message_type_t message_type;
   size_t nbytes;
   void *data;
 } message_t;
 
+/* Ids of actors are opaque, they are neither dense nor in order of
+ * spawning. A place of a dead actor is taken by new actors under new ids,
+ * old ids come back only after 2^31 actors have used the place.
+ */
 typedef long actor_id_t;
 
+// Returned by actor_id_self() outside of a handler, never a valid id.
+#define ACTOR_ID_NONE (actor_id_t)-1
+
 actor_id_t actor_id_self();
 
 typedef void (*const act_t)(void **stateptr, size_t nbytes, void *data);
 
+// Actors of a role with this flag may block in handlers, they run on a separate pool of threads.
+#define ROLE_BLOCKING 0x1
+
 typedef struct role {
   size_t nprompts;
   act_t *prompts;
+  unsigned long flags; // ROLE_ flags, taken when an actor of the role is spawned.
 } role_t;
 
+// Settings of an actor system, zeroed fields mean defaults.
+typedef struct cacti_config {
+  size_t pool_size; // Number of threads, by default the number of online CPUs.
+  /* If not NULL, thread i of the pool runs only on CPU cpus[i % number_of_cpus],
+   * other threads of the system on any of them. The process has to be allowed to use them.
+   */
+  const int *cpus;
+  size_t number_of_cpus; // Length of cpus.
+  size_t actor_queue_limit; // Messages an actor can have waiting, below 2^24 - 255, ACTOR_QUEUE_LIMIT by default.
+  size_t urgent_queue_limit; // Same for the urgent lane, at most 255, URGENT_QUEUE_LIMIT by default.
+  size_t cast_limit; // Maximal number of actors alive at once, at most 2^32, CAST_LIMIT by default.
+  size_t stack_size; // Stack size of threads in bytes, system`s default by default.
+  size_t blocking_pool_limit; // Most threads for actors with ROLE_BLOCKING, BLOCKING_POOL_LIMIT by default.
+  /* If not 0, messages sent by handlers on the pool`s threads are staged
+   * and delivered together when the handler returns, one push for every
+   * receiver and one wake-up for every thread. Places in the queues are
+   * taken only then, send functions report errors as they see the queues
+   * when sending, and a message whose receiver is dead or whose lane is
+   * full by then is dropped.
+   */
+  int buffer_sends;
+  /* If not NULL, events of the threads are traced and written to this file
+   * at actor_system_join as Chrome trace-event JSON, readable by Perfetto.
+   * Ignored unless compiled with CACTI_TRACE.
+   */
+  const char *trace_path;
+} cacti_config_t;
+
+// Creates an actor system with POOL_SIZE threads and compile-time limits.
 int actor_system_create(actor_id_t *actor, role_t *const role);
 
+/* Creates an actor system set up by config, which can be NULL. Returns 0,
+ * or -1 if the config cannot be met, e.g. it names a CPU the process may
+ * not use.
+ */
+int actor_system_create_ex(actor_id_t *actor, role_t *const role, const cacti_config_t *config);
+
 void actor_system_join(actor_id_t actor);
 
+/* Lanes of an actor`s queue. Messages of the urgent lane are received
+ * before the normal ones and have their own limit, so they neither wait
+ * behind nor are rejected because of a full normal lane. MSG_SPAWN and
+ * MSG_GODIE go to the urgent lane, other messages only if sent by
+ * send_message_to_lane.
+ */
+typedef enum message_lane {
+  LANE_NORMAL,
+  LANE_URGENT
+} message_lane_t;
+
+/* Sends a message to the normal lane, MSG_SPAWN and MSG_GODIE to the
+ * urgent one and ACTOR_QUEUE_IS_FULL if it is full. Other messages of one
+ * sender are received in the order they were sent. MSG_SPAWN overtakes
+ * them, MSG_GODIE takes effect after all messages waiting when it arrives,
+ * so an actor gets MSG_GODIE after everything sent to him before.
+ */
 int send_message(actor_id_t actor, message_t message);
 
+/* Sends a message to the given lane of the actor`s queue. A message sent to
+ * the urgent lane overtakes the normal ones, when the urgent lane is full
+ * it goes to the normal one.
+ */
+int send_message_to_lane(actor_id_t actor, message_t message, message_lane_t lane);
+
+/* Spawns n actors of the role at once, as if the calling actor sent
+ * himself n MSG_SPAWN, and puts their ids into out. Places of dead actors
+ * are taken first, so the ids need not be consecutive. Their MSG_HELLO are
+ * delivered together, spread over threads. Can be called only by
+ * a handler. Returns the number of actors spawned, fewer than n if
+ * CAST_LIMIT is reached, or ACTOR_ID_INCORRECT outside of a handler.
+ */
+long spawn_actors(role_t *role, size_t n, actor_id_t *out);
+
+/* Sends n messages to one actor in one step, in order, all to the normal
+ * lane. Returns how many of them were sent, those that did not fit into
+ * the actor`s queue are not. If none was sent returns the error code
+ * send_message would return.
+ */
+long send_messages(actor_id_t actor, message_t *messages, size_t n);
+
+/* Strategies of routers. A message sent to a router goes straight to one
+ * of its members, chosen when it is sent.
+ */
+typedef enum router_strategy {
+  ROUTER_ROUND_ROBIN, // Members in turn.
+  ROUTER_CONSISTENT_HASH, // Member given by the key of send_message_with_key, in turn without a key.
+  ROUTER_LEAST_LOADED // Member with fewer waiting messages out of two picked at random.
+} router_strategy_t;
+
+/* Spawns n actors of the role, like spawn_actors, and a router in front of
+ * them, whose id goes to router. Any send function given the router`s id
+ * sends to a member, send_messages sends all messages to one. Puts the
+ * members` ids into members if it is not NULL. The router is not an actor,
+ * it receives nothing, members die as any other actors. The router dies
+ * with the last of them, from then on its id is rejected like a dead
+ * actor`s and its place is taken by new actors. Can be called only by
+ * a handler. Returns the number of members, fewer than n if CAST_LIMIT is
+ * reached, or ACTOR_ID_INCORRECT.
+ */
+long spawn_router(role_t *role, size_t n, router_strategy_t strategy, actor_id_t *members, actor_id_t *router);
+
+/* Like send_message, with the key choosing the member of a router with
+ * ROUTER_CONSISTENT_HASH. Messages with the same key go to the same member.
+ */
+int send_message_with_key(actor_id_t actor, message_t message, unsigned long key);
+
+/* Sends a message with a copy of nbytes of data. Small data is kept in the
+ * message itself, larger goes to a block from cacti_alloc(). Either way the
+ * handler gets a pointer valid until it returns and frees nothing.
+ */
+int send_message_copy(actor_id_t actor, message_type_t message_type, const void *data, size_t nbytes);
+
+/* Sends the message to each of n actors, to the lane send_message would
+ * choose. If results is not NULL, results[i] gets what send_message would
+ * return for actors[i]. Returns the number of actors the message was sent to.
+ */
+long broadcast_message(const actor_id_t *actors, size_t n, message_t message, int *results);
+
+/* Allocates a buffer of nbytes for data sent to many actors without a
+ * copy, by send_message_shared and broadcast_message_shared. The caller
+ * holds a reference until cacti_free_shared(), every queued message holds
+ * one until its handler returns, and the last one frees the buffer.
+ * Receivers must not change it.
+ */
+void *cacti_alloc_shared(size_t nbytes);
+
+// Adds a reference to a shared buffer, for a handler keeping it after it returns.
+void cacti_retain_shared(void *data);
+
+// Drops a reference to a shared buffer.
+void cacti_free_shared(void *data);
+
+// Like send_message, with message.data from cacti_alloc_shared(), which is not copied.
+int send_message_shared(actor_id_t actor, message_t message);
+
+/* Like broadcast_message, with message.data from cacti_alloc_shared(), which
+ * is not copied. Once the calling thread has sent as many messages before,
+ * the broadcast itself allocates nothing.
+ */
+long broadcast_message_shared(const actor_id_t *actors, size_t n, message_t message, int *results);
+
+/* Sets how many messages a thread receives from one actor before moving on
+ * to other actors and, unless time_budget_us is 0, for how many microseconds
+ * at most. Can be called at any time, takes effect with the next actor.
+ */
+void actor_system_set_quantum(size_t messages, unsigned long time_budget_us);
+
+/* Sets how a thread without actors waits for work: it looks around spins
+ * times with a pause instruction in between, then yields times giving up
+ * the CPU, then goes to sleep. Can be called at any time.
+ */
+void actor_system_set_idle_policy(size_t spins, size_t yields);
+
+typedef long request_id_t;
+
+/* Data given to the handler of a request: the data of the request and the
+ * handle to reply with. It is valid until the reply is sent.
+ */
+typedef struct cacti_request {
+  request_id_t reply_to; // Handle for send_reply.
+  size_t nbytes; // Nbytes of the request.
+  void *data; // Data of the request.
+} cacti_request_t;
+
+/* Sends the message as a request, its handler gets a pointer to
+ * a cacti_request_t as data. The reply comes to the calling actor as
+ * a message of reply_type with the replied nbytes and data. Can be called
+ * only by a handler. Returns the error code send_message would return, or
+ * ACTOR_ID_INCORRECT outside of a handler.
+ */
+int send_request(actor_id_t actor, message_t message, message_type_t reply_type);
+
+/* Like send_request, but the reply is kept until wait_for_reply, so it can
+ * be called by any thread. Returns the handle of the request, or the error
+ * code send_message would return.
+ */
+request_id_t send_request_future(actor_id_t actor, message_t message);
+
+/* Waits for the reply to a request from send_request_future and puts its
+ * nbytes and data into reply. Returns 0, or -1 if there is no such request
+ * or the system has died without replying.
+ */
+int wait_for_reply(request_id_t request, message_t *reply);
+
+/* Replies to a request, the data is owned by the caller as with
+ * send_message. Returns 0, or -1 if the request has already been replied.
+ */
+int send_reply(request_id_t reply_to, size_t nbytes, void *data);
+
+typedef long timer_id_t;
+
+/* Sends the message to the actor after delay_us microseconds, to the lane
+ * send_message would choose. Returns id of the timer for cancel_timer, or
+ * the error code send_message would return now. The message is dropped if
+ * the actor is dead or his queue is full when the timer expires. A message
+ * to a router goes to the member chosen then, it is dropped if that member
+ * has died, even if others live.
+ */
+timer_id_t send_message_after(actor_id_t actor, message_t message, unsigned long delay_us);
+
+/* Like send_message_after, then sends the message again every period_us
+ * microseconds until the timer is cancelled or the actor dies. A period
+ * shorter than a tick is one tick.
+ */
+timer_id_t send_message_every(actor_id_t actor, message_t message, unsigned long delay_us,
+                              unsigned long period_us);
+
+/* Cancels a timer. Returns 0, or -1 if the timer has already expired (for
+ * a one-shot timer) or has been cancelled.
+ */
+int cancel_timer(timer_id_t timer);
+
+/* Allocates a block for message data from the current thread`s slabs, so
+ * it can be sent by pointer and freed by the receiver with cacti_free().
+ * Blocks are taken back to their thread`s slabs from any thread. Valid
+ * only while the system is alive, all blocks are released at
+ * actor_system_join.
+ */
+void *cacti_alloc(size_t nbytes);
+
+void cacti_free(void *data);
+
+// Counters of one thread of the pool since the system was created.
+typedef struct cacti_worker_stats {
+  unsigned long messages; // Messages received by actors on the thread.
+  unsigned long handler_ns; // Time spent receiving messages.
+  unsigned long idle_ns; // Time spent asleep waiting for actors with messages.
+  unsigned long steals; // Actors taken from queues of other threads.
+  unsigned long queue_length; // Actors waiting in the thread`s queue now.
+  unsigned long queue_high_water; // Most actors waiting in the thread`s queue at once.
+} cacti_worker_stats_t;
+
+// Counters of the whole system since it was created.
+typedef struct cacti_stats {
+  size_t pool_size; // Number of threads.
+  unsigned long messages; // Messages received by all actors.
+  unsigned long sent; // Messages accepted by send functions.
+  unsigned long queue_full; // Messages rejected because the actor`s queue was full.
+  unsigned long actor_dead; // Messages rejected because the actor was dead.
+  unsigned long spawns; // Actors spawned with MSG_SPAWN.
+  unsigned long mailbox_high_water; // Most messages any actor has had waiting at once.
+  cacti_worker_stats_t *workers; // If not NULL, gets counters of the first number_of_workers threads.
+  size_t number_of_workers; // Length of workers.
+} cacti_stats_t;
+
+// Counters of one actor.
+typedef struct cacti_actor_stats {
+  unsigned long messages; // Messages received by the actor.
+  unsigned long queue_length; // Messages waiting in the actor`s queue now.
+  unsigned long queue_high_water; // Most messages waiting in the actor`s queue at once.
+} cacti_actor_stats_t;
+
+/* Fills stats of the running system, counters are summed up from all threads
+ * at the moment of the call. Returns 0, or -1 if statistics are compiled out.
+ */
+int cacti_get_stats(cacti_stats_t *stats);
+
+/* Fills stats of a living actor. Returns 0, or -1 if the actor does not exist
+ * or statistics are compiled out.
+ */
+int cacti_get_actor_stats(actor_id_t actor, cacti_actor_stats_t *stats);
+
 #endif
\ No newline at end of file
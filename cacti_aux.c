@@ -1,241 +1,964 @@
+#define _GNU_SOURCE
 #include "cacti_aux.h"
 #include "global.h"
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
 
 /* Definition of global variables.
  */
 
-bool is_the_system_alive; // True when the system can shut down.
-uint64_t number_of_actors; // Number of actors in the system.
-uint64_t number_of_dead_and_finished_actors; // Actors that have empty queues and are dead.
+atomic_bool is_the_system_alive; // False when the system can shut down.
+atomic_uint_fast64_t number_of_actors; // Number of places in the actors table, indices below it are valid.
+padded_counter number_of_living_actors; // Actors that are not dead or still have messages.
+uint64_t *free_actors; // Indices of places in the actors table left by dead actors.
+uint64_t number_of_free_actors, free_actors_size; // Number of free places and length of the array.
 pthread_mutex_t mutex; // Mutex for access to make global data changes.
 pthread_attr_t attr; // pthread_attr_t for threads.
-pthread_t th[POOL_SIZE]; // Threads` ids.
-actor_id_t performing_actor[POOL_SIZE]; // Which actor is performing in a thread.
-pthread_cond_t cond[POOL_SIZE]; // Thread will go to sleep when it has nothing to do.
-
-actor_info *actors; // An array of actors` info.
-uint64_t actor_info_length; // Length of an actors array.
+uint32_t pool_size; // Number of threads.
+uint64_t actor_queue_limit; // Messages an actor can have waiting.
+uint64_t urgent_queue_limit; // Messages an actor can have waiting in the urgent lane.
+uint64_t cast_limit; // Maximal number of actors.
+bool is_outbox_enabled; // Handlers on the pool`s threads stage their messages, see cacti_config_t.buffer_sends.
+pthread_t *th; // Threads` ids.
+pthread_cond_t *cond; // Thread will go to sleep when it has nothing to do.
+padded_counter queue_epoch; // Incremented on every push, lets idle threads notice work to steal.
+_Thread_local actor_id_t performing_actor = ACTOR_ID_NONE; // Which actor is performing in the current thread.
+_Thread_local uint32_t current_thread_number = UINT32_MAX; // Number of the current thread, BLOCKING_THREAD_NUMBER outside of the pool.
+atomic_size_t throughput_quantum = THROUGHPUT_QUANTUM; // Messages received from one actor in a row.
+atomic_uint_fast64_t quantum_time_budget = 0; // Nanoseconds spent on one actor in a row, 0 for no limit.
+atomic_size_t idle_spins = IDLE_SPINS; // Pauses of a thread without actors before yielding.
+atomic_size_t idle_yields = IDLE_YIELDS; // Yields of a thread without actors before going to sleep.
+padded_counter number_of_spinning_threads; // Threads waiting for work without sleeping.
+#if CACTI_STATS
+thread_stats *stats_of_threads; // Pool_size blocks and one for threads outside of the pool.
+_Thread_local thread_stats *current_thread_stats; // Block of the current thread, NULL outside of the pool.
+uint64_t finished_actors_high_water; // Mailbox high-water mark of actors already reclaimed.
+#endif
+#if CACTI_TRACE
+trace_buffer *trace_buffers; // Pool_size rings and one for threads outside of the pool, NULL if not tracing.
+_Thread_local trace_buffer *current_trace_buffer; // Ring of the current thread, NULL outside of the pool.
+uint64_t trace_start; // Time of creating the system.
+char *trace_path; // File the trace is written to.
+#endif
+
+// Spare message nodes shared by all threads.
+node_depot message_nodes;
+
+// Free message nodes of the current thread.
+static _Thread_local struct {
+  message_node *free_nodes; // List of free nodes.
+  uint64_t number_of_free_nodes; // Length of the list.
+  uint64_t generation; // Generation of the depot the nodes come from.
+} local_nodes;
+
+// Messages staged by the handler running in the current thread.
+static _Thread_local struct {
+  staged_messages *staged; // Vector of staged messages, in order of sending.
+  uint64_t number_of_staged, size; // Number of entries and length of the vector.
+  actor_id_t *runnable; // Receivers to be made runnable, as long as the vector.
+} local_outbox;
+
+// True while the current thread flushes the outbox of an actor whose turn is over.
+static _Thread_local bool is_turn_ending;
+
+// Vectors of the current thread for making many actors runnable, reused by every call.
+static _Thread_local struct {
+  uint64_t *begin; // Ends of groups in add_actors_to_thread_queues.
+  actor_id_t *grouped; // Actors sorted by groups in add_actors_to_thread_queues.
+  actor_id_t *runnable; // Actors made runnable by a broadcast, see get_runnable_scratch.
+  uint64_t begin_size, grouped_size, runnable_size; // Lengths of the vectors.
+} local_scratch;
+
+// Payload cache of the current thread.
+static _Thread_local struct {
+  payload_cache *cache; // Cache registered in payload_caches.
+  uint64_t generation; // Generation of the depot when the cache was made.
+} local_payloads;
+
+payload_cache *payload_caches; // Caches of all threads that have allocated payloads.
+
+// All timers of the system.
+timer_wheel timers;
+
+// Requests waiting for replies.
+request_table requests;
+
+router *routers; // All routers of the system, dead ones included.
+
+// Routers without references, waiting for reuse.
+struct free_router_list free_routers;
+
+// State of the generator choosing members of ROUTER_LEAST_LOADED in the current thread.
+static _Thread_local uint64_t router_random;
+
+/* Actors` info, kept in segments of ACTORS_SEGMENT_SIZE actors each.
+ * A segment is never moved or freed while the system is alive, so
+ * pointers to actor_info stay valid.
+ */
+actor_info **actors;
 
 /* Actor_buffer, one for every thread acting as a queue.
  * If actor is in the buffer it means he has a message to receive.
  */
 actor_buffer *actor_q;
 
-// Initializes global memory of the current actor system.
-void initialize() {
+// Threads for actors with ROLE_BLOCKING.
+blocking_pool blocking_threads;
+
+/* Initializes global memory of the current actor system. The config is
+ * already checked, its zeroed fields are replaced with defaults.
+ */
+void initialize(const cacti_config_t *config) {
   int err;
-  is_the_system_alive = true;
-  number_of_actors = 1;
-  number_of_dead_and_finished_actors = 0;
-  actor_info_length = 1;
+  long online_cpus;
+
+  if (config->pool_size > 0) {
+    pool_size = config->pool_size;
+  } else {
+    online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    pool_size = (online_cpus > 0 ? online_cpus : 1);
+  }
+  actor_queue_limit = (config->actor_queue_limit > 0 ? config->actor_queue_limit : ACTOR_QUEUE_LIMIT);
+  urgent_queue_limit = (config->urgent_queue_limit > 0 ? config->urgent_queue_limit : URGENT_QUEUE_LIMIT);
+  cast_limit = (config->cast_limit > 0 ? config->cast_limit : CAST_LIMIT);
+  is_outbox_enabled = (config->buffer_sends != 0);
+  routers = free_routers.first = NULL;
+
+  atomic_init(&is_the_system_alive, true);
+  atomic_init(&number_of_actors, 1);
+  atomic_init(&number_of_living_actors.value, 1);
+  free_actors = NULL;
+  number_of_free_actors = free_actors_size = 0;
+  atomic_init(&queue_epoch.value, 0);
+  atomic_init(&number_of_spinning_threads.value, 0);
   if ((err = pthread_mutex_init(&mutex, 0)) != 0)
     handle_error_en(err, "pthread_mutex_init");
   if ((err = pthread_attr_init(&attr)) != 0)
     handle_error_en(err, "pthread_attr_init");
+  if (config->stack_size > 0 && (err = pthread_attr_setstacksize(&attr, config->stack_size)) != 0)
+    handle_error_en(err, "pthread_attr_setstacksize");
+
+  // Attr gets CPUs of the pool`s threads, blocking threads and the timer thread may use all of them.
+  if ((err = pthread_attr_init(&blocking_threads.attr)) != 0)
+    handle_error_en(err, "pthread_attr_init");
+  if (config->stack_size > 0 &&
+      (err = pthread_attr_setstacksize(&blocking_threads.attr, config->stack_size)) != 0)
+    handle_error_en(err, "pthread_attr_setstacksize");
+  if (config->cpus != NULL) {
+    cpu_set_t cpus;
+
+    CPU_ZERO(&cpus);
+    for (size_t i = 0; i < config->number_of_cpus; i++)
+      CPU_SET(config->cpus[i], &cpus);
+    if ((err = pthread_attr_setaffinity_np(&blocking_threads.attr, sizeof(cpu_set_t), &cpus)) != 0)
+      handle_error_en(err, "pthread_attr_setaffinity_np");
+  }
+  check_alloc_validity(blocking_threads.queue.actor_id = malloc(sizeof(actor_id_t)));
+  blocking_threads.queue.size = 1;
+  blocking_threads.queue.number_of_actors = 0;
+#if CACTI_STATS
+  blocking_threads.queue.high_water = 0;
+#endif
+  blocking_threads.queue.writepos = blocking_threads.queue.readpos = 0;
+  atomic_init(&blocking_threads.queue.is_sleeping, false);
+  if ((err = pthread_mutex_init(&blocking_threads.queue.lock, 0)) != 0)
+    handle_error_en(err, "pthread_mutex_init");
+  // Idle blocking threads and the timer thread wait until times of the monotonic clock.
+  pthread_condattr_t condattr;
+  if ((err = pthread_condattr_init(&condattr)) != 0)
+    handle_error_en(err, "pthread_condattr_init");
+  if ((err = pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC)) != 0)
+    handle_error_en(err, "pthread_condattr_setclock");
+  if ((err = pthread_cond_init(&blocking_threads.cond, &condattr)) != 0)
+    handle_error_en(err, "pthread_cond_init");
+  blocking_threads.threads = blocking_threads.retired = NULL;
+  blocking_threads.number_of_threads = blocking_threads.threads_size = 0;
+  blocking_threads.number_of_retired = blocking_threads.retired_size = 0;
+  blocking_threads.number_of_idle_threads = 0;
+  blocking_threads.limit = (config->blocking_pool_limit > 0 ? config->blocking_pool_limit : BLOCKING_POOL_LIMIT);
+
+  if ((err = pthread_mutex_init(&message_nodes.lock, 0)) != 0)
+    handle_error_en(err, "pthread_mutex_init");
+  message_nodes.batches = message_nodes.chunks = NULL;
+  message_nodes.number_of_batches = message_nodes.batches_size = 0;
+  message_nodes.number_of_chunks = message_nodes.chunks_size = 0;
+  message_nodes.generation++;
+  payload_caches = NULL;
 
-  check_alloc_validity(actors = malloc(sizeof(actor_info)));
-  check_alloc_validity(actors[0].msg_q.messages = malloc(ACTOR_QUEUE_LIMIT * sizeof(message_t)));
-  if ((err = pthread_mutex_init(&actors[0].lock, 0)) != 0)
+  if ((err = pthread_mutex_init(&timers.lock, 0)) != 0)
+    handle_error_en(err, "pthread_mutex_init");
+  if ((err = pthread_cond_init(&timers.cond, &condattr)) != 0)
+    handle_error_en(err, "pthread_cond_init");
+  if ((err = pthread_condattr_destroy(&condattr)) != 0)
+    handle_error_en(err, "pthread_condattr_destroy");
+  if ((err = pthread_mutex_init(&requests.lock, 0)) != 0)
     handle_error_en(err, "pthread_mutex_init");
-  actors[0].msg_q.writepos = actors[0].msg_q.readpos = actors[0].msg_q.number_of_messages = 0;
-  actors[0].is_actor_dead = false;
 
-  check_alloc_validity(actor_q = malloc(POOL_SIZE * sizeof(actor_buffer)));
-  for (uint32_t i = 0; i < POOL_SIZE; i++) {
+  if ((err = pthread_mutex_init(&free_routers.lock, 0)) != 0)
+    handle_error_en(err, "pthread_mutex_init");
+  if ((err = pthread_cond_init(&requests.cond, 0)) != 0)
+    handle_error_en(err, "pthread_cond_init");
+  requests.chunks = NULL;
+  requests.number_of_chunks = requests.chunks_size = 0;
+  requests.number_of_slots = 0;
+  requests.free_slots = -1;
+
+  timers.is_thread_running = false;
+  timers.start_ns = get_time_ns();
+  timers.tick_ns = (uint64_t) TIMER_TICK_US * 1000;
+  timers.current = 0;
+  timers.wake_tick = UINT64_MAX;
+  for (int i = 0; i < TIMER_LEVELS * TIMER_SLOTS; i++)
+    timers.slots[i] = -1;
+  timers.entries = NULL;
+  timers.number_of_entries = timers.entries_size = 0;
+  timers.free_entries = -1;
+  timers.number_of_pending = 0;
+  timers.fired = NULL;
+  timers.runnable = NULL;
+  timers.number_of_fired = timers.fired_size = 0;
+
+  // The table of segments is big enough for cast_limit actors, so it never grows.
+  check_alloc_validity(actors = calloc((cast_limit + ACTORS_SEGMENT_SIZE - 1) / ACTORS_SEGMENT_SIZE,
+                                       sizeof(actor_info *)));
+  check_alloc_validity(actors[0] = aligned_alloc(_Alignof(actor_info), ACTORS_SEGMENT_SIZE * sizeof(actor_info)));
+
+  check_alloc_validity(th = malloc(pool_size * sizeof(pthread_t)));
+  check_alloc_validity(cond = malloc(pool_size * sizeof(pthread_cond_t)));
+  check_alloc_validity(actor_q = aligned_alloc(_Alignof(actor_buffer), pool_size * sizeof(actor_buffer)));
+#if CACTI_STATS
+  check_alloc_validity(stats_of_threads = aligned_alloc(_Alignof(thread_stats),
+                                                        (pool_size + 1) * sizeof(thread_stats)));
+  for (uint32_t i = 0; i <= pool_size; i++)
+    for (int j = 0; j < NUMBER_OF_STAT_COUNTERS; j++)
+      atomic_init(&stats_of_threads[i].counters[j], 0);
+  finished_actors_high_water = 0;
+#endif
+#if CACTI_TRACE
+  trace_buffers = NULL;
+  if (config->trace_path != NULL) {
+    check_alloc_validity(trace_path = strdup(config->trace_path));
+    check_alloc_validity(trace_buffers = aligned_alloc(_Alignof(trace_buffer),
+                                                       (pool_size + 1) * sizeof(trace_buffer)));
+    for (uint32_t i = 0; i <= pool_size; i++) {
+      atomic_init(&trace_buffers[i].number_of_events, 0);
+      check_alloc_validity(trace_buffers[i].events = malloc(TRACE_BUFFER_SIZE * sizeof(trace_event)));
+    }
+    trace_start = get_time_ns();
+  }
+#endif
+  for (uint32_t i = 0; i < pool_size; i++) {
     check_alloc_validity(actor_q[i].actor_id = malloc(sizeof(actor_id_t)));
     actor_q[i].size = 1;
     actor_q[i].number_of_actors = 0;
+#if CACTI_STATS
+    actor_q[i].high_water = 0;
+#endif
     actor_q[i].writepos = actor_q[i].readpos = 0;
     if ((err = pthread_mutex_init(&actor_q[i].lock, 0)) != 0)
       handle_error_en(err, "pthread_mutex_init");
 
     if ((err = pthread_cond_init(&cond[i], 0)) != 0)
       handle_error_en(err, "pthread_cond_init");
+    atomic_init(&actor_q[i].is_sleeping, false);
   }
 }
 
+// Fills in info of a brand new actor with an empty buffer of messages.
+void initialize_actor(actor_id_t actor, actor_id_t parent, role_t *role) {
+  actor_info *info = get_actor(actor);
+
+  info->id = actor;
+  info->parent = parent;
+  info->role = role;
+  info->state = NULL;
+  info->is_blocking = (role->flags & ROLE_BLOCKING) != 0;
+  // Old ids of the place may still be used, they only ever see NULL here.
+  atomic_store_explicit(&info->router, NULL, memory_order_relaxed);
+  atomic_init(&info->home_thread, get_actor_index(actor) % pool_size);
+  atomic_init(&info->affinity_thread, 0);
+  atomic_init(&info->affinity_votes, 0);
+
+  // Nodes are taken from the pool only when messages arrive.
+  for (int i = 0; i < NUMBER_OF_LANES; i++) {
+    atomic_init(&info->msg_q.lanes[i].stub.next, NULL);
+    info->heads[i] = get_stub(&info->msg_q.lanes[i]);
+    atomic_init(&info->msg_q.lanes[i].tail, get_stub(&info->msg_q.lanes[i]));
+  }
+#if CACTI_STATS
+  atomic_init(&info->messages_received, 0);
+  atomic_init(&info->queue_high_water, 0);
+#endif
+
+  // Messages can be sent to the actor from now on.
+  atomic_store(&info->msg_q.number_of_messages, get_actor_generation(actor) << GENERATION_SHIFT);
+}
+
 void clean_system_memory() {
   int err;
 
-  for (uint64_t i = 0; i < number_of_actors; i++) {
-    if ((err = pthread_mutex_destroy(&actors[i].lock)) != 0)
-      handle_error_en(err, "pthread_mutex_destroy");
+  uint64_t actors_count = atomic_load(&number_of_actors);
 
-    free(actors[i].msg_q.messages);
-  }
+  for (uint64_t i = 0; i * ACTORS_SEGMENT_SIZE < actors_count; i++)
+    free(actors[i]);
   free(actors);
+  free(free_actors);
+
+  // Arrays of routers without references are already freed.
+  while (routers != NULL) {
+    router *next_router = routers->next_router;
+
+    free(routers->members);
+    free(routers->ring);
+    free(routers);
+    routers = next_router;
+  }
+
+  // Nodes still listed by threads are dropped, the depot`s generation changes.
+  for (uint64_t i = 0; i < message_nodes.number_of_chunks; i++)
+    free(message_nodes.chunks[i]);
+  free(message_nodes.chunks);
+  free(message_nodes.batches);
+
+  // Payload caches are dropped by threads the same way.
+  while (payload_caches != NULL) {
+    payload_cache *cache = payload_caches;
+
+    payload_caches = cache->next;
+    for (uint64_t i = 0; i < cache->number_of_chunks; i++)
+      free(cache->chunks[i]);
+    free(cache->chunks);
+    free(cache);
+  }
 
-  for (uint32_t i = 0; i < POOL_SIZE; i++) {
+  if ((err = pthread_mutex_destroy(&message_nodes.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_destroy");
+
+  free(blocking_threads.queue.actor_id);
+  free(blocking_threads.threads);
+  free(blocking_threads.retired);
+  if ((err = pthread_mutex_destroy(&blocking_threads.queue.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_destroy");
+  if ((err = pthread_cond_destroy(&blocking_threads.cond)) != 0)
+    handle_error_en(err, "pthread_cond_destroy");
+  if ((err = pthread_attr_destroy(&blocking_threads.attr)) != 0)
+    handle_error_en(err, "pthread_attr_destroy");
+
+  for (uint64_t i = 0; i < requests.number_of_chunks; i++)
+    free(requests.chunks[i]);
+  free(requests.chunks);
+  if ((err = pthread_mutex_destroy(&requests.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_destroy");
+
+  if ((err = pthread_mutex_destroy(&free_routers.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_destroy");
+  if ((err = pthread_cond_destroy(&requests.cond)) != 0)
+    handle_error_en(err, "pthread_cond_destroy");
+
+  free(timers.entries);
+  free(timers.fired);
+  free(timers.runnable);
+  if ((err = pthread_mutex_destroy(&timers.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_destroy");
+  if ((err = pthread_cond_destroy(&timers.cond)) != 0)
+    handle_error_en(err, "pthread_cond_destroy");
+
+  for (uint32_t i = 0; i < pool_size; i++) {
     if ((err = pthread_mutex_destroy(&actor_q[i].lock)) != 0)
       handle_error_en(err, "pthread_mutex_destroy");
+    if ((err = pthread_cond_destroy(&cond[i])) != 0)
+      handle_error_en(err, "pthread_cond_destroy");
 
     free(actor_q[i].actor_id);
   }
   free(actor_q);
+  free(cond);
+  free(th);
+#if CACTI_STATS
+  free(stats_of_threads);
+  stats_of_threads = NULL;
+#endif
+#if CACTI_TRACE
+  if (trace_buffers != NULL) {
+    for (uint32_t i = 0; i <= pool_size; i++)
+      free(trace_buffers[i].events);
+    free(trace_buffers);
+    free(trace_path);
+    trace_buffers = NULL;
+  }
+#endif
+
+  if ((err = pthread_attr_destroy(&attr)) != 0)
+    handle_error_en(err, "pthread_attr_destroy");
 }
 
-void update_state_of_the_system(actor_id_t actor) {
+/* Returns true if the actor still has messages to receive, lane is the one
+ * of the received message.
+ */
+bool update_state_of_the_system(actor_id_t actor, message_lane_t lane, uint32_t thread_number) {
   int err;
+  bool is_system_finished;
+  // The received message is no longer counted.
+  uint64_t received = (uint64_t) 1 << LANE_SHIFT[lane];
+  uint64_t messages_left = atomic_fetch_sub(&get_actor(actor)->msg_q.number_of_messages, received) - received;
+
+#if CACTI_STATS
+  /* Only receiving takes messages away, so the queue is the longest right
+   * before it. Counting it here keeps writers off the actor`s mark.
+   */
+  atomic_uint_fast64_t *high_water = &get_actor(actor)->queue_high_water;
+  if (count_messages(messages_left) + 1 > atomic_load_explicit(high_water, memory_order_relaxed))
+    atomic_store_explicit(high_water, count_messages(messages_left) + 1, memory_order_relaxed);
+#endif
 
-  // I need to obtain exclusive access to the *actor_with_message data.
-  if ((err = pthread_mutex_lock(&actors[actor].lock)) != 0)
-    handle_error_en(err, "pthread_mutex_lock");
+  if ((messages_left & MESSAGES_MASK) > 0)
+    return true;
+
+  if (!(messages_left & ACTOR_DEAD_FLAG))
+    return false;
+
+  /* Actor has already received MSG_GODIE and has no more messages on his queue.
+   * Nobody can send him a message anymore, so it happens only once.
+   */
 
   // Acquiring access to global data.
   if ((err = pthread_mutex_lock(&mutex)) != 0)
     handle_error_en(err, "pthread_mutex_lock");
 
-  if (actors[actor].is_actor_dead && actors[actor].msg_q.number_of_messages == 0) {
-    // Actor has already received MSG_GODIE and has no more messages on his queue.
-    number_of_dead_and_finished_actors++;
-  }
+  reclaim_actor(actor);
 
-  if (number_of_dead_and_finished_actors == number_of_actors) {
+  if ((err = pthread_mutex_unlock(&mutex)) != 0)
+    handle_error_en(err, "pthread_mutex_unlock");
+
+  /* Actors are spawned only by living actors, which are counted before
+   * their spawner can finish, so once the count drops to 0 it stays there.
+   */
+  is_system_finished = (atomic_fetch_sub(&number_of_living_actors.value, 1) == 1);
+  if (is_system_finished) {
     // System can shut down, all actors are dead.
+    atomic_store(&is_the_system_alive, false);
+    wake_up_all_threads(thread_number);
+  }
 
-    is_the_system_alive = false;
-    for (int i = 0; i < POOL_SIZE; i++) {
-      if (i != (actor % POOL_SIZE)) {
-        if ((err = pthread_cond_signal(&cond[i])) != 0)
-          handle_error_en(err, "pthread_cond_signal");
-      }
-    }
+  return false;
+}
+
+// Wakes up every thread except the calling one, so they can notice that the system is dead.
+void wake_up_all_threads(uint32_t thread_number) {
+  int err;
+
+  for (uint32_t i = 0; i < pool_size; i++) {
+    if (i == thread_number)
+      continue;
+
+    /* Signalling under the queue`s lock, a thread checks is_system_dead()
+     * holding that lock right before it goes to sleep.
+     */
+    if ((err = pthread_mutex_lock(&actor_q[i].lock)) != 0)
+      handle_error_en(err, "pthread_mutex_lock");
+
+    if ((err = pthread_cond_signal(&cond[i])) != 0)
+      handle_error_en(err, "pthread_cond_signal");
+
+    if ((err = pthread_mutex_unlock(&actor_q[i].lock)) != 0)
+      handle_error_en(err, "pthread_mutex_unlock");
   }
 
-  if ((err = pthread_mutex_unlock(&mutex)) != 0)
+  // Blocking threads, the timer thread and threads waiting for replies check is_system_dead() holding their locks too.
+  if ((err = pthread_mutex_lock(&requests.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  if ((err = pthread_cond_broadcast(&requests.cond)) != 0)
+    handle_error_en(err, "pthread_cond_broadcast");
+
+  if ((err = pthread_mutex_unlock(&requests.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_unlock");
+
+  if ((err = pthread_mutex_lock(&blocking_threads.queue.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  if ((err = pthread_cond_broadcast(&blocking_threads.cond)) != 0)
+    handle_error_en(err, "pthread_cond_broadcast");
+
+  if ((err = pthread_mutex_unlock(&blocking_threads.queue.lock)) != 0)
     handle_error_en(err, "pthread_mutex_unlock");
 
-  if ((err = pthread_mutex_unlock(&actors[actor].lock)) != 0)
+  if ((err = pthread_mutex_lock(&timers.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  if ((err = pthread_cond_signal(&timers.cond)) != 0)
+    handle_error_en(err, "pthread_cond_signal");
+
+  if ((err = pthread_mutex_unlock(&timers.lock)) != 0)
     handle_error_en(err, "pthread_mutex_unlock");
 }
 
-void adjust_size_of_actors_data() {
+// If needed allocates new segments of the actors table for the next n actors.
+void adjust_size_of_actors_data(uint64_t n) {
   // Here I have access to the global data.
-  if (number_of_actors == actor_info_length) {
-    // Here I need to block the whole system. All the threads.
-    int err;
+  uint64_t actor = atomic_load(&number_of_actors);
 
-    for (uint32_t i = 0; i < POOL_SIZE; i++) {
-      if ((err = pthread_mutex_lock(&actor_q[i].lock)) != 0)
-        handle_error_en(err, "pthread_mutex_lock");
-    }
+  /* Running threads are not disturbed, existing segments stay in place and
+   * the new ones become visible together with the new actors.
+   */
+  for (uint64_t segment = (actor + ACTORS_SEGMENT_SIZE - 1) / ACTORS_SEGMENT_SIZE;
+       segment * ACTORS_SEGMENT_SIZE < actor + n; segment++)
+    check_alloc_validity(actors[segment] = aligned_alloc(_Alignof(actor_info), ACTORS_SEGMENT_SIZE * sizeof(actor_info)));
+}
 
-    actor_info_length = (actor_info_length + 1) * MULTIPLIER / DIVIDER;
-    check_alloc_validity(actors = realloc(actors, actor_info_length * sizeof(actor_info)));
+// If needed adjusts queue`s size, so that n more actors fit in.
+void adjust_size_of_queue(actor_buffer *q, uint64_t n) {
+  // I have exclusive access to the queue.
 
-    for (uint32_t i = 0; i < POOL_SIZE; i++) {
-      if ((err = pthread_mutex_unlock(&actor_q[i].lock)) != 0)
-        handle_error_en(err, "pthread_mutex_unlock");
-    }
-  }
+  if (q->number_of_actors + n > q->size) {
+    // The queue has to be resized, actors are laid out again starting from position 0.
+    uint64_t new_size = q->size;
+    actor_id_t *new_actor_id;
 
-  actors[number_of_actors].msg_q.messages = malloc(ACTOR_QUEUE_LIMIT * sizeof(message_t));
-}
+    while (q->number_of_actors + n > new_size)
+      new_size = (new_size + 1) * MULTIPLIER / DIVIDER;
+
+    check_alloc_validity(new_actor_id = malloc(new_size * sizeof(actor_id_t)));
+    for (uint64_t i = 0; i < q->number_of_actors; i++)
+      new_actor_id[i] = q->actor_id[(q->readpos + i) % q->size];
 
-// If needed adjusts thread`s queue size.
-void adjust_size_of_queue(uint32_t thread_number) {
-  // I have exclusive access to the thread`s queue.
-  if (actor_q[thread_number].number_of_actors == actor_q[thread_number].size) {
-    // The queue has to be resized.
-    uint32_t new_size = (actor_q[thread_number].size + 1) * MULTIPLIER / DIVIDER;
-    check_alloc_validity(actor_q[thread_number].actor_id =
-                           realloc(actor_q[thread_number].actor_id, new_size * sizeof(actor_id_t)));
+    free(q->actor_id);
+    q->actor_id = new_actor_id;
+    q->readpos = 0;
+    q->writepos = q->number_of_actors;
+    q->size = new_size;
   }
 }
 
 bool is_system_dead() {
+  return !atomic_load(&is_the_system_alive);
+}
+
+void receive_hello(actor_id_t actor, message_t message) {
+  act_t aux = get_actor(actor)->role->prompts[message.message_type];
+
+  /* If the receiver is not the first actor of the system, then message.data
+   * is the pointer to some actor`s id.
+   */
+  aux(&get_actor(actor)->state, message.nbytes, message.data);
+}
+
+/* Returns the id of a new actor in the place of some dead actor, whose
+ * generation has already been advanced. Called with access to global data,
+ * when there is a free place.
+ */
+static actor_id_t take_free_place() {
+  uint64_t index = free_actors[--number_of_free_actors];
+  uint64_t generation = atomic_load(&actors[index / ACTORS_SEGMENT_SIZE][index % ACTORS_SEGMENT_SIZE]
+                                       .msg_q.number_of_messages) >> GENERATION_SHIFT;
+
+  return (actor_id_t) (generation << ACTOR_INDEX_BITS | index);
+}
+
+void create_new_actor(actor_id_t *new_actor, actor_id_t parent, message_t message) {
+  // I have to get access to the global data.
   int err;
-  bool aux;
 
-  // Acquiring access to global data.
   if ((err = pthread_mutex_lock(&mutex)) != 0)
     handle_error_en(err, "pthread_mutex_lock");
 
-  aux = is_the_system_alive;
+  if (number_of_free_actors > 0) {
+    *new_actor = take_free_place();
+    initialize_actor(*new_actor, parent, (role_t *) message.data);
+  } else {
+    if (atomic_load(&number_of_actors) == cast_limit)
+      exit(1);
+
+    adjust_size_of_actors_data(1);
+
+    *new_actor = atomic_load(&number_of_actors);
+    initialize_actor(*new_actor, parent, (role_t *) message.data);
+
+    // Publishing the place, from now on messages can be sent to the actor.
+    atomic_fetch_add(&number_of_actors, 1);
+  }
+
+  // The child starts next to his parent, they are likely to talk.
+  if (current_thread_number < pool_size)
+    atomic_store_explicit(&get_actor(*new_actor)->home_thread, current_thread_number, memory_order_relaxed);
+
+  atomic_fetch_add(&number_of_living_actors.value, 1);
+  add_to_stat(STAT_SPAWNS, 1);
+  trace_event_if_tracing(TRACE_SPAWN, *new_actor, parent, 0);
 
   if ((err = pthread_mutex_unlock(&mutex)) != 0)
     handle_error_en(err, "pthread_mutex_unlock");
-
-  return !aux;
 }
 
-void receive_hello(actor_id_t actor, message_t message) {
+/* Spawns at most n actors of the role with one access to global data, in
+ * places of dead actors first, then in consecutive places at the end of
+ * the actors table. Each of them gets MSG_HELLO already in his buffer, so
+ * the caller only has to make them runnable. Returns the number of actors,
+ * fewer than n if cast_limit is reached.
+ */
+uint64_t create_new_actors(actor_id_t *new_actors, uint64_t n, actor_id_t parent, role_t *role) {
   int err;
+  uint64_t first, reused, appended;
+  actor_info *info;
+  message_node *node;
+
+  if ((err = pthread_mutex_lock(&mutex)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  reused = (n < number_of_free_actors ? n : number_of_free_actors);
+  first = atomic_load(&number_of_actors);
+  appended = n - reused;
+  if (appended > cast_limit - first)
+    appended = cast_limit - first;
+  n = reused + appended;
+
+  adjust_size_of_actors_data(appended);
+
+  for (uint64_t i = 0; i < n; i++) {
+    new_actors[i] = (i < reused ? take_free_place() : (actor_id_t) (first + i - reused));
+    initialize_actor(new_actors[i], parent, role);
+    info = get_actor(new_actors[i]);
+
+    /* Nobody knows the actor yet, his first message is linked behind the
+     * stub and counted without atomic operations, publishing makes it
+     * visible. Old ids of a reused place are rejected by the generation.
+     */
+    node = allocate_message_node();
+    node->message = (message_t) {MSG_HELLO, sizeof(actor_id_t), &info->parent};
+    node->payload = PAYLOAD_POINTER;
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&info->msg_q.lanes[LANE_URGENT].stub.next, node, memory_order_relaxed);
+    atomic_store_explicit(&info->msg_q.lanes[LANE_URGENT].tail, node, memory_order_relaxed);
+    atomic_store_explicit(&info->msg_q.number_of_messages,
+                          atomic_load_explicit(&info->msg_q.number_of_messages, memory_order_relaxed) +
+                            ((uint64_t) 1 << LANE_SHIFT[LANE_URGENT]),
+                          memory_order_relaxed);
+    trace_event_if_tracing(TRACE_SPAWN, new_actors[i], parent, 0);
+  }
 
-  act_t aux = actors[actor].role->prompts[message.message_type];
-  if ((err = pthread_mutex_unlock(&actors[actor].lock)) != 0)
+  // Publishing all new places at once.
+  atomic_fetch_add(&number_of_actors, appended);
+  atomic_fetch_add(&number_of_living_actors.value, n);
+  add_to_stat(STAT_SPAWNS, n);
+
+  if ((err = pthread_mutex_unlock(&mutex)) != 0)
     handle_error_en(err, "pthread_mutex_unlock");
 
-  /* If the receiver is not the first actor of the system, then message.data
-   * is the pointer to some actor`s id.
-   */
-  aux(&actors[actor].state, message.nbytes, message.data);
+  return n;
 }
 
-void create_new_actor(actor_id_t *new_actor, message_t message) {
-  // I have to get access to the global data.
+/* Makes a router without members, with space for n members of the role,
+ * out of a dead router if there is one. It takes the place of some dead
+ * actor, whose old ids are rejected by the generation, or a new place at
+ * the end of the actors table. The caller holds a reference to it, to be
+ * released by release_router. Returns NULL if cast_limit is reached.
+ */
+router *create_router(router_strategy_t strategy, uint64_t n, role_t *role) {
   int err;
+  router *new_router = NULL;
+  bool is_free_place;
 
   if ((err = pthread_mutex_lock(&mutex)) != 0)
     handle_error_en(err, "pthread_mutex_lock");
 
-  adjust_size_of_actors_data();
+  is_free_place = (number_of_free_actors > 0);
+  if (is_free_place || atomic_load(&number_of_actors) < cast_limit) {
+    if ((err = pthread_mutex_lock(&free_routers.lock)) != 0)
+      handle_error_en(err, "pthread_mutex_lock");
+
+    new_router = free_routers.first;
+    if (new_router != NULL)
+      free_routers.first = new_router->next_free_router;
 
-  actors[number_of_actors].id = number_of_actors;
-  *new_actor = actors[number_of_actors].id;
-  actors[number_of_actors].is_actor_dead = false;
-  actors[number_of_actors].role = (role_t *) message.data;
-  actors[number_of_actors].msg_q.number_of_messages =
-  actors[number_of_actors].msg_q.readpos = actors[number_of_actors].msg_q.writepos = 0;
-  if ((err = pthread_mutex_init(&actors[number_of_actors].lock, 0)) != 0)
-    handle_error_en(err, "pthread_mutex_init");
+    if ((err = pthread_mutex_unlock(&free_routers.lock)) != 0)
+      handle_error_en(err, "pthread_mutex_unlock");
+
+    if (new_router == NULL) {
+      check_alloc_validity(new_router = calloc(1, sizeof(router)));
+      new_router->next_router = routers;
+      routers = new_router;
+    }
+
+    check_alloc_validity(new_router->members = malloc(n * sizeof(actor_id_t)));
+    new_router->ring = NULL;
+    new_router->strategy = strategy;
+    new_router->number_of_members = new_router->number_of_living_members = 0;
+    atomic_store_explicit(&new_router->next, 0, memory_order_relaxed);
+
+    if (is_free_place) {
+      new_router->id = take_free_place();
+    } else {
+      adjust_size_of_actors_data(1);
+      new_router->id = atomic_load(&number_of_actors);
+    }
+    initialize_actor(new_router->id, ACTOR_ID_NONE, role);
+    // No message ever comes to the place itself, it is dead from the start.
+    atomic_store(&get_actor(new_router->id)->msg_q.number_of_messages,
+                 get_actor_generation(new_router->id) << GENERATION_SHIFT | ACTOR_DEAD_FLAG);
 
-  number_of_actors++;
+    // Senders still holding the struct of a dead router see it again only with the new id.
+    atomic_store_explicit(&new_router->references, 2, memory_order_release);
 
-  if (number_of_actors > CAST_LIMIT)
-    exit(1);
+    if (!is_free_place)
+      atomic_fetch_add(&number_of_actors, 1);
+  }
 
   if ((err = pthread_mutex_unlock(&mutex)) != 0)
     handle_error_en(err, "pthread_mutex_unlock");
+
+  return new_router;
 }
 
-void receive_spawn(actor_id_t actor, message_t message) {
+/* Drops a reference to the router. The last one frees its arrays, the
+ * struct waits for a new router, as senders may still be looking at it.
+ */
+void release_router(router *r) {
   int err;
 
-  actor_id_t new_actor;
-  create_new_actor(&new_actor, message);
+  if (atomic_fetch_sub_explicit(&r->references, 1, memory_order_acq_rel) != 1)
+    return;
+
+  free(r->members);
+  free(r->ring);
+  r->members = NULL;
+  r->ring = NULL;
+
+  if ((err = pthread_mutex_lock(&free_routers.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  r->next_free_router = free_routers.first;
+  free_routers.first = r;
 
-  if ((err = pthread_mutex_unlock(&actors[actor].lock)) != 0)
+  if ((err = pthread_mutex_unlock(&free_routers.lock)) != 0)
     handle_error_en(err, "pthread_mutex_unlock");
+}
+
+// Mixes bits of a key, so that close keys land far apart on the ring.
+static uint64_t mix_bits(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111eb;
+  x ^= x >> 31;
 
-  // Sending hello message to the new actor.
-  message_t aux = {MSG_HELLO, sizeof(actor_id_t), &actors[actor].id};
-  send_message(actors[new_actor].id, aux);
+  return x;
 }
 
-void receive_godie(actor_id_t actor) {
-  int err;
-  if ((err = pthread_mutex_unlock(&actors[actor].lock)) != 0)
-    handle_error_en(err, "pthread_mutex_unlock");
+static int compare_router_points(const void *a, const void *b) {
+  const router_point *x = a, *y = b;
 
-  actors[actor].is_actor_dead = true;
+  return (x->hash > y->hash) - (x->hash < y->hash);
 }
 
-void receive_standard_message(actor_id_t actor, message_t message) {
+/* Sets the number of members already put into the router`s members and
+ * makes it route messages. Called before the members are made runnable,
+ * a router without members dies at once.
+ */
+void set_router_members(router *r, uint64_t n) {
   int err;
-  act_t aux = actors[actor].role->prompts[message.message_type];
 
-  if ((err = pthread_mutex_unlock(&actors[actor].lock)) != 0)
-    handle_error_en(err, "pthread_mutex_unlock");
+  r->number_of_members = r->number_of_living_members = n;
+
+  // Each member knows his router, so that the last one to die frees its place.
+  for (uint64_t i = 0; i < n; i++)
+    atomic_store_explicit(&get_actor(r->members[i])->router, r, memory_order_relaxed);
+
+  if (r->strategy == ROUTER_CONSISTENT_HASH && n > 0) {
+    check_alloc_validity(r->ring = malloc(n * ROUTER_RING_POINTS * sizeof(router_point)));
+    // Mixed twice, so that points do not fall on hashes of small keys.
+    for (uint64_t i = 0; i < n * ROUTER_RING_POINTS; i++)
+      r->ring[i] = (router_point) {mix_bits(mix_bits(i)), i / ROUTER_RING_POINTS};
+    qsort(r->ring, n * ROUTER_RING_POINTS, sizeof(router_point), compare_router_points);
+  }
+
+  atomic_store_explicit(&get_actor(r->id)->router, r, memory_order_release);
+
+  if (n == 0) {
+    if ((err = pthread_mutex_lock(&mutex)) != 0)
+      handle_error_en(err, "pthread_mutex_lock");
+
+    reclaim_actor(r->id);
+
+    if ((err = pthread_mutex_unlock(&mutex)) != 0)
+      handle_error_en(err, "pthread_mutex_unlock");
+  }
+}
+
+// Returns the member owning the first point of the ring at or after the hash.
+static uint64_t find_ring_member(router *r, uint64_t hash) {
+  uint64_t begin = 0, end = r->number_of_members * ROUTER_RING_POINTS, middle;
+
+  while (begin < end) {
+    middle = begin + (end - begin) / 2;
+    if (r->ring[middle].hash < hash)
+      begin = middle + 1;
+    else
+      end = middle;
+  }
+
+  // Past the last point the ring wraps around.
+  return r->ring[begin % (r->number_of_members * ROUTER_RING_POINTS)].member;
+}
+
+// Returns a random number from the current thread`s generator (xorshift64*).
+static uint64_t get_router_random() {
+  if (router_random == 0)
+    router_random = mix_bits((uint64_t) (uintptr_t) &router_random) | 1;
+
+  router_random ^= router_random >> 12;
+  router_random ^= router_random << 25;
+  router_random ^= router_random >> 27;
+
+  return router_random * 0x2545f4914f6cdd1d;
+}
+
+// Returns the number of messages waiting for a member, dead members count as the most loaded.
+static uint64_t get_member_load(actor_id_t member) {
+  uint64_t number_of_messages = atomic_load_explicit(&get_actor(member)->msg_q.number_of_messages,
+                                                     memory_order_relaxed);
+
+  return (number_of_messages & ACTOR_DEAD_FLAG ? UINT64_MAX : count_messages(number_of_messages));
+}
+
+/* Returns the router with a valid id and takes a reference to it, to be
+ * released by release_router. NULL if the id is not of a router with members.
+ */
+router *get_router(actor_id_t actor) {
+  router *r = atomic_load_explicit(&get_actor(actor)->router, memory_order_acquire);
+  uint_fast64_t references;
+
+  if (r == NULL)
+    return NULL;
+
+  // A router without references is never taken again, until it is made anew.
+  references = atomic_load_explicit(&r->references, memory_order_relaxed);
+  do {
+    if (references == 0)
+      return NULL;
+  } while (!atomic_compare_exchange_weak_explicit(&r->references, &references, references + 1,
+                                                  memory_order_acquire, memory_order_relaxed));
+
+  // The struct may serve a new router by now, or the id may be of a member.
+  if (r->id != actor || r->number_of_members == 0) {
+    release_router(r);
+    return NULL;
+  }
+
+  return r;
+}
+
+/* Returns the receiver of a message sent to a valid id: a member chosen
+ * by the router if the id is a router`s, the id itself otherwise. Key is
+ * NULL if the sender has given none.
+ */
+actor_id_t route_message(actor_id_t actor, const uint64_t *key) {
+  router *r = get_router(actor);
+  uint64_t member, other;
+
+  if (r == NULL)
+    return actor;
+
+  if (r->strategy == ROUTER_CONSISTENT_HASH && key != NULL) {
+    member = find_ring_member(r, mix_bits(*key));
+  } else if (r->strategy == ROUTER_LEAST_LOADED) {
+    // The better of two random members, it spreads almost as well as the best of all.
+    member = get_router_random() % r->number_of_members;
+    other = get_router_random() % r->number_of_members;
+    if (get_member_load(r->members[other]) < get_member_load(r->members[member]))
+      member = other;
+  } else {
+    member = atomic_fetch_add_explicit(&r->next, 1, memory_order_relaxed) % r->number_of_members;
+  }
+
+  actor = r->members[member];
+  release_router(r);
+
+  return actor;
+}
+
+/* Frees the place of a dead actor without messages, or of a router, for
+ * a new actor. The generation of the place changes, so messages sent with
+ * the old id are rejected as sent to a dead actor. The last member of
+ * a router frees the router`s place too, and the router drops the
+ * reference held for it. Called with access to global data.
+ */
+void reclaim_actor(actor_id_t actor) {
+  actor_info *info = get_actor(actor);
+  uint64_t generation = (get_actor_generation(actor) + 1) % ((uint64_t) 1 << (64 - GENERATION_SHIFT));
+  router *r = atomic_load_explicit(&info->router, memory_order_relaxed);
+
+  if (r != NULL && r->id != actor && --r->number_of_living_members == 0)
+    reclaim_actor(r->id);
+
+  if (r != NULL && r->id == actor) {
+    atomic_store_explicit(&info->router, NULL, memory_order_relaxed);
+    release_router(r);
+  }
 
-  aux(&actors[actor].state, message.nbytes, message.data);
+  // The place stays dead until it is taken.
+  atomic_store(&info->msg_q.number_of_messages, generation << GENERATION_SHIFT | ACTOR_DEAD_FLAG);
+  info->role = NULL;
+  info->state = NULL;
+#if CACTI_STATS
+  if (atomic_load(&info->queue_high_water) > finished_actors_high_water)
+    finished_actors_high_water = atomic_load(&info->queue_high_water);
+#endif
+
+  if (number_of_free_actors == free_actors_size) {
+    free_actors_size = (free_actors_size + 1) * MULTIPLIER / DIVIDER;
+    check_alloc_validity(free_actors = realloc(free_actors, free_actors_size * sizeof(uint64_t)));
+  }
+  free_actors[number_of_free_actors++] = get_actor_index(actor);
+}
+
+void receive_spawn(actor_id_t actor, message_t message) {
+  actor_id_t new_actor;
+  create_new_actor(&new_actor, actor, message);
+
+  /* Sending hello message to the new actor. The parent`s id is kept by the
+   * new actor, as the parent`s place might be taken by someone else.
+   */
+  message_t aux = {MSG_HELLO, sizeof(actor_id_t), &get_actor(new_actor)->parent};
+  send_message(new_actor, aux);
+}
+
+void receive_godie(actor_id_t actor) {
+  // From now on every message sent to the actor is rejected.
+  atomic_fetch_or(&get_actor(actor)->msg_q.number_of_messages, ACTOR_DEAD_FLAG);
+  trace_event_if_tracing(TRACE_GODIE, actor, 0, 0);
+}
+
+void receive_standard_message(actor_id_t actor, message_t message) {
+  act_t aux = get_actor(actor)->role->prompts[message.message_type];
+
+  aux(&get_actor(actor)->state, message.nbytes, message.data);
 }
 
-void actor_receive_message(actor_id_t actor_with_message) {
-  // Here I still have exclusive access to the actor`s info.
-  message_t message;
+// Returns the lane the message was taken from.
+message_lane_t receive_one_message(actor_id_t actor_with_message) {
+  message_lane_t lane;
+  // Here I am the only reader of the actor`s buffer.
+  message_node *node = obtain_message(actor_with_message, &lane);
+  message_t message = node->message;
+  message_buffer *msg_q = &get_actor(actor_with_message)->msg_q;
+
+  /* MSG_GODIE overtakes normal messages only to find a place, it takes
+   * effect behind those already waiting, so it goes to the end of their lane.
+   */
+  if (lane == LANE_URGENT && message.message_type == MSG_GODIE &&
+      get_lane_messages(atomic_load(&msg_q->number_of_messages), LANE_NORMAL) > 0) {
+    atomic_fetch_add(&msg_q->number_of_messages, (uint64_t) 1 << LANE_SHIFT[LANE_NORMAL]);
+    push_message_node(&msg_q->lanes[LANE_NORMAL], node);
+    return lane;
+  }
 
-  obtain_message(actor_with_message, &message);
+#if CACTI_STATS
+  // Only the thread processing the actor writes it.
+  atomic_uint_fast64_t *messages_received = &get_actor(actor_with_message)->messages_received;
+  atomic_store_explicit(messages_received, atomic_load_explicit(messages_received, memory_order_relaxed) + 1,
+                        memory_order_relaxed);
+#endif
 
   switch (message.message_type) {
     case MSG_HELLO:
@@ -251,106 +974,1755 @@ void actor_receive_message(actor_id_t actor_with_message) {
       receive_standard_message(actor_with_message, message);
   }
 
-  update_state_of_the_system(actor_with_message);
-}
-
-// Gets id of an actor with messages, updates the queue accordingly to the situation.
-void get_actor_to_receive_message(actor_id_t *actor_with_message, uint32_t thread_number) {
-  int err;
-
-  *actor_with_message = actor_q[thread_number].actor_id[actor_q[thread_number].readpos];
-  performing_actor[thread_number] = *actor_with_message;
-  actor_q[thread_number].readpos =
-    (actor_q[thread_number].readpos + 1) % actor_q[thread_number].size;
+  // Data copied by send_message_copy lives until the handler returns.
+  release_message(node);
 
-  // I need to obtain exclusive access to the *actor_with_message data.
-  if ((err = pthread_mutex_lock(&actors[*actor_with_message].lock)) != 0)
-    handle_error_en(err, "pthread_mutex_lock");
+  return lane;
+}
 
-  if (actors[*actor_with_message].msg_q.number_of_messages > 1) {
-    actor_q[thread_number].actor_id[actor_q[thread_number].writepos] = *actor_with_message;
-    actor_q[thread_number].writepos =
-      (actor_q[thread_number].writepos + 1) % actor_q[thread_number].size;
-  } else {
-    actor_q[thread_number].number_of_actors--;
+/* Receives messages of one actor, at most throughput_quantum of them and
+ * within quantum_time_budget, so his data stays in cache. If some are left,
+ * the actor goes to the back of the thread`s queue.
+ */
+void actor_receive_message(actor_id_t actor_with_message, uint32_t thread_number) {
+  size_t quantum = atomic_load_explicit(&throughput_quantum, memory_order_relaxed);
+  uint64_t time_budget = atomic_load_explicit(&quantum_time_budget, memory_order_relaxed);
+  uint64_t deadline = (time_budget > 0 ? get_time_ns() + time_budget : 0);
+  uint64_t start = get_stats_time_ns(), trace_start_ns = get_trace_time_ns();
+  size_t received = 0;
+  message_lane_t lane;
+  bool has_messages, has_migrated;
+
+  // Before the quantum the actor is surely alive, he can move to the thread that keeps making him runnable.
+  has_migrated = (thread_number < pool_size && migrate_actor(actor_with_message));
+  performing_actor = actor_with_message;
+
+  do {
+    lane = receive_one_message(actor_with_message);
+    // Messages sent by the handler go out before the actor can receive his own.
+    if (local_outbox.number_of_staged > 0) {
+      is_turn_ending = (received + 1 >= quantum || (deadline != 0 && get_time_ns() >= deadline) ||
+                        count_messages(atomic_load(&get_actor(actor_with_message)->msg_q.number_of_messages)) <= 1);
+      flush_outbox();
+      is_turn_ending = false;
+    }
+    received++;
+    has_messages = update_state_of_the_system(actor_with_message, lane, thread_number);
+  } while (has_messages && received < quantum && (deadline == 0 || get_time_ns() < deadline));
+
+  performing_actor = ACTOR_ID_NONE;
+
+  add_to_stat(STAT_MESSAGES, received);
+  add_to_stat(STAT_HANDLER_NS, get_stats_time_ns() - start);
+  trace_event_if_tracing(TRACE_RECEIVE, actor_with_message, received, trace_start_ns);
+
+  if (has_messages && has_migrated) {
+    // Remaining messages are received by the new home thread.
+    add_actors_to_thread_queue(&actor_with_message, 1, get_home_thread(actor_with_message));
+  } else if (has_messages) {
+    // Actor still has messages to receive, it stays with the current thread or pool.
+    if (get_actor(actor_with_message)->is_blocking)
+      push_blocking_actors(&actor_with_message, 1);
+    else
+      push_actor_to_queue(actor_with_message, thread_number, NULL);
   }
 }
 
-void obtain_message(actor_id_t actor, message_t *message) {
-  // Here I have exclusive access to the actor`s info.
-  *message = actors[actor].msg_q.messages[actors[actor].msg_q.readpos];
-  actors[actor].msg_q.readpos = (actors[actor].msg_q.readpos + 1) % ACTOR_QUEUE_LIMIT;
-  actors[actor].msg_q.number_of_messages--;
+/* Moves the actor to the thread that has won his votes, if it is not his
+ * home thread. Called only by the thread owning the actor. Returns
+ * true if the actor has moved.
+ */
+bool migrate_actor(actor_id_t actor) {
+#if MIGRATION_VOTES > 0
+  actor_info *info = get_actor(actor);
+  uint_fast32_t target = atomic_load_explicit(&info->affinity_thread, memory_order_relaxed);
+
+  if (info->is_blocking ||
+      atomic_load_explicit(&info->affinity_votes, memory_order_relaxed) < MIGRATION_VOTES ||
+      target == atomic_load_explicit(&info->home_thread, memory_order_relaxed))
+    return false;
+
+  atomic_store_explicit(&info->home_thread, target, memory_order_relaxed);
+  atomic_store_explicit(&info->affinity_votes, 0, memory_order_relaxed);
+  return true;
+#else
+  (void) actor;
+  return false;
+#endif
 }
 
-void add_actor_to_thread_queue(actor_id_t actor) {
-  int err;
-  uint32_t thread_number = actor % POOL_SIZE;
+/* Waits for some actor to be pushed since the epoch without going to sleep,
+ * first with pauses, then giving up the CPU, as work often comes soon after
+ * a thread runs out of it. Returns true if something was pushed or the
+ * system is dead.
+ */
+bool wait_for_new_actors(uint_fast64_t epoch) {
+  size_t spins = atomic_load_explicit(&idle_spins, memory_order_relaxed);
+  size_t yields = atomic_load_explicit(&idle_yields, memory_order_relaxed);
+  bool is_pushed = false;
 
-  // Acquiring access to thread`s queue.
-  if ((err = pthread_mutex_lock(&actor_q[thread_number].lock)) != 0)
-    handle_error_en(err, "pthread_mutex_lock");
+  // Threads pushing actors do not wake anyone up while someone is spinning.
+  atomic_fetch_add(&number_of_spinning_threads.value, 1);
 
-  adjust_size_of_queue(thread_number);
+  for (size_t i = 0; i < spins + yields && !is_pushed; i++) {
+    if (i < spins)
+      cpu_relax();
+    else
+      sched_yield();
 
-  if (actor_q[thread_number].number_of_actors == 0) {
-    // The thread is asleep, we have to wake it up.
-    if ((err = pthread_cond_signal(&cond[thread_number])) != 0)
-      handle_error_en(err, "pthread_cond_signal");
+    is_pushed = (epoch != atomic_load(&queue_epoch.value) || is_system_dead());
   }
 
-  // Now there must be enough place for another actor_id_t.
-  actor_q[thread_number].actor_id[actor_q[thread_number].writepos] = actor;
-  actor_q[thread_number].number_of_actors++;
-  actor_q[thread_number].writepos =
-    (actor_q[thread_number].writepos + 1) % actor_q[thread_number].size;
+  atomic_fetch_sub(&number_of_spinning_threads.value, 1);
 
-  // Returning access to the queue.
-  if ((err = pthread_mutex_unlock(&actor_q[thread_number].lock)) != 0)
-    handle_error_en(err, "pthread_mutex_unlock");
+  return is_pushed;
 }
 
-// Code that POOL_SIZE threads have to execute.
-void *thread_task(void *data) {
-  uint32_t thread_number = *(uint32_t *) (data);
+/* Gets id of an actor with messages, from the thread`s own queue or stolen
+ * from another thread. Waits for a while and then sleeps if there is
+ * nothing to do. Returns false if the system is dead.
+ */
+bool get_actor_to_receive_message(actor_id_t *actor_with_message, uint32_t thread_number) {
   int err;
-  actor_id_t actor_with_message;
+  uint_fast64_t epoch;
+  uint64_t sleep_start, trace_sleep_start;
 
   while (true) {
-    if (is_system_dead())
+    epoch = atomic_load(&queue_epoch.value);
+
+    if (pop_actor_from_queue(actor_with_message, thread_number) ||
+        steal_actor_from_other_queue(actor_with_message, thread_number))
       break;
 
+    if (wait_for_new_actors(epoch)) {
+      if (is_system_dead())
+        return false;
+      continue;
+    }
+
     // Acquiring access to thread`s queue.
     if ((err = pthread_mutex_lock(&actor_q[thread_number].lock)) != 0)
       handle_error_en(err, "pthread_mutex_lock");
 
-    while (actor_q[thread_number].number_of_actors == 0) {
-      // Thread has nothing to do. Better for it to go to sleep.
-      if ((err = pthread_cond_wait(&cond[thread_number], &actor_q[thread_number].lock)) != 0)
-        handle_error_en(err, "pthread_cond_wait");
+    atomic_store(&actor_q[thread_number].is_sleeping, true);
 
+    /* If some actor was pushed since the last look around, it might be
+     * possible to steal it, so the thread does not go to sleep.
+     */
+    while (actor_q[thread_number].number_of_actors == 0 && epoch == atomic_load(&queue_epoch.value)) {
       if (is_system_dead())
         break;
-    }
-
-    if (actor_q[thread_number].number_of_actors == 0) {
-      if ((err = pthread_mutex_unlock(&actor_q[thread_number].lock)) != 0)
-        handle_error_en(err, "pthread_mutex_unlock");
 
-      break;
+      // Thread has nothing to do. Better for it to go to sleep.
+      sleep_start = get_stats_time_ns();
+      trace_sleep_start = get_trace_time_ns();
+      if ((err = pthread_cond_wait(&cond[thread_number], &actor_q[thread_number].lock)) != 0)
+        handle_error_en(err, "pthread_cond_wait");
+      add_to_stat(STAT_IDLE_NS, get_stats_time_ns() - sleep_start);
+      trace_event_if_tracing(TRACE_SLEEP, ACTOR_ID_NONE, 0, trace_sleep_start);
     }
 
-    // Here, the thread does have the mutex and there is at least one actor with some messages.
-    get_actor_to_receive_message(&actor_with_message, thread_number);
+    atomic_store(&actor_q[thread_number].is_sleeping, false);
 
-    // Returning access to the queue.
     if ((err = pthread_mutex_unlock(&actor_q[thread_number].lock)) != 0)
       handle_error_en(err, "pthread_mutex_unlock");
 
-    actor_receive_message(actor_with_message);
+    if (is_system_dead())
+      return false;
   }
 
-  free(data);
+  return true;
+}
 
-  return NULL;
+// Takes a free message node from the current thread`s list, refilled from the depot.
+message_node *allocate_message_node() {
+  int err;
+  message_node *node;
+
+  if (local_nodes.generation != message_nodes.generation) {
+    // Nodes listed by the thread belonged to some previous system.
+    local_nodes.free_nodes = NULL;
+    local_nodes.number_of_free_nodes = 0;
+    local_nodes.generation = message_nodes.generation;
+  }
+
+  if (local_nodes.free_nodes == NULL) {
+    if ((err = pthread_mutex_lock(&message_nodes.lock)) != 0)
+      handle_error_en(err, "pthread_mutex_lock");
+
+    if (message_nodes.number_of_batches > 0) {
+      local_nodes.free_nodes = message_nodes.batches[--message_nodes.number_of_batches];
+    } else {
+      // No spare nodes anywhere, a new chunk is needed.
+      if (message_nodes.number_of_chunks == message_nodes.chunks_size) {
+        message_nodes.chunks_size = (message_nodes.chunks_size + 1) * MULTIPLIER / DIVIDER;
+        check_alloc_validity(message_nodes.chunks =
+                               realloc(message_nodes.chunks, message_nodes.chunks_size * sizeof(message_node *)));
+      }
+
+      check_alloc_validity(node = malloc(MESSAGE_NODES_BATCH_SIZE * sizeof(message_node)));
+      message_nodes.chunks[message_nodes.number_of_chunks++] = node;
+
+      for (uint64_t i = 0; i < MESSAGE_NODES_BATCH_SIZE; i++)
+        atomic_init(&node[i].next, i + 1 < MESSAGE_NODES_BATCH_SIZE ? &node[i + 1] : NULL);
+      local_nodes.free_nodes = node;
+    }
+
+    if ((err = pthread_mutex_unlock(&message_nodes.lock)) != 0)
+      handle_error_en(err, "pthread_mutex_unlock");
+
+    local_nodes.number_of_free_nodes = MESSAGE_NODES_BATCH_SIZE;
+  }
+
+  node = local_nodes.free_nodes;
+  local_nodes.free_nodes = atomic_load_explicit(&node->next, memory_order_relaxed);
+  local_nodes.number_of_free_nodes--;
+
+  return node;
+}
+
+/* Puts a message node back on the current thread`s list. Surplus goes to
+ * the depot, so nodes freed by readers get back to writers.
+ */
+void release_message_node(message_node *node) {
+  int err;
+  message_node *batch;
+
+  if (local_nodes.generation != message_nodes.generation) {
+    local_nodes.free_nodes = NULL;
+    local_nodes.number_of_free_nodes = 0;
+    local_nodes.generation = message_nodes.generation;
+  }
+
+  atomic_store_explicit(&node->next, local_nodes.free_nodes, memory_order_relaxed);
+  local_nodes.free_nodes = node;
+  local_nodes.number_of_free_nodes++;
+
+  if (local_nodes.number_of_free_nodes < 2 * MESSAGE_NODES_BATCH_SIZE)
+    return;
+
+  // Cutting off a batch from the front of the list.
+  batch = local_nodes.free_nodes;
+  for (uint64_t i = 1; i < MESSAGE_NODES_BATCH_SIZE; i++)
+    node = atomic_load_explicit(&node->next, memory_order_relaxed);
+  local_nodes.free_nodes = atomic_load_explicit(&node->next, memory_order_relaxed);
+  atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+  local_nodes.number_of_free_nodes -= MESSAGE_NODES_BATCH_SIZE;
+
+  if ((err = pthread_mutex_lock(&message_nodes.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  if (message_nodes.number_of_batches == message_nodes.batches_size) {
+    message_nodes.batches_size = (message_nodes.batches_size + 1) * MULTIPLIER / DIVIDER;
+    check_alloc_validity(message_nodes.batches =
+                           realloc(message_nodes.batches, message_nodes.batches_size * sizeof(message_node *)));
+  }
+  message_nodes.batches[message_nodes.number_of_batches++] = batch;
+
+  if ((err = pthread_mutex_unlock(&message_nodes.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_unlock");
+}
+
+/* Releases a node received or dropped, with its data if the node holds it,
+ * shared data as long as it has other references.
+ */
+void release_message(message_node *node) {
+  if (node->payload == PAYLOAD_OWNED)
+    release_payload(node->message.data);
+  else if (node->payload == PAYLOAD_SHARED)
+    release_shared_payload(node->message.data, 1);
+  release_message_node(node);
+}
+
+/* Appends a list of linked nodes to the queue, safe to be called by many
+ * writers at once.
+ */
+void push_message_nodes(message_queue *queue, message_node *first, message_node *last) {
+  message_node *prev;
+
+  atomic_store_explicit(&last->next, NULL, memory_order_relaxed);
+  prev = atomic_exchange_explicit(&queue->tail, last, memory_order_acq_rel);
+  // Until this store the reader cannot go past prev.
+  atomic_store_explicit(&prev->next, first, memory_order_release);
+}
+
+void push_message_node(message_queue *queue, message_node *node) {
+  push_message_nodes(queue, node, node);
+}
+
+/* Takes places for at most n messages in the lane, unless the actor is
+ * dead or the lane is full. If may_change_lane, a full urgent lane is
+ * replaced with the normal one, *lane gets the lane the places are in.
+ * Returns the number of places or an error code, *number_of_messages gets
+ * the number of messages before.
+ */
+static long take_places_in_buffer(actor_id_t actor, size_t n, message_lane_t *lane, bool may_change_lane,
+                                  uint64_t *number_of_messages) {
+  message_buffer *msg_q = &get_actor(actor)->msg_q;
+  message_lane_t requested_lane = *lane;
+  uint64_t places, waiting;
+
+  *number_of_messages = atomic_load(&msg_q->number_of_messages);
+  do {
+    // A different generation means that the actor is dead and his place is taken.
+    if ((*number_of_messages & ACTOR_DEAD_FLAG) ||
+        *number_of_messages >> GENERATION_SHIFT != get_actor_generation(actor)) {
+      add_to_stat(STAT_ACTOR_DEAD, n);
+      return ACTOR_IS_DEAD;
+    }
+
+    *lane = requested_lane;
+    if (may_change_lane && *lane == LANE_URGENT && get_lane_messages(*number_of_messages, LANE_URGENT) >= urgent_queue_limit)
+      *lane = LANE_NORMAL;
+
+    waiting = get_lane_messages(*number_of_messages, *lane);
+    if (waiting >= (*lane == LANE_URGENT ? urgent_queue_limit : actor_queue_limit)) {
+      add_to_stat(STAT_QUEUE_FULL, n);
+      return ACTOR_QUEUE_IS_FULL;
+    }
+
+    places = (*lane == LANE_URGENT ? urgent_queue_limit : actor_queue_limit) - waiting;
+    if (places > n)
+      places = n;
+  } while (!atomic_compare_exchange_weak(&msg_q->number_of_messages, number_of_messages,
+                                         *number_of_messages + (places << LANE_SHIFT[*lane])));
+
+  add_to_stat(STAT_SENT, places);
+  add_to_stat(STAT_QUEUE_FULL, n - places);
+  trace_event_if_tracing(TRACE_SEND, actor, places, 0);
+
+  return places;
+}
+
+// Returns true if messages sent now wait in the outbox of the current thread.
+static bool is_outbox_open() {
+  return is_outbox_enabled && current_thread_number < pool_size && performing_actor != ACTOR_ID_NONE;
+}
+
+/* Returns the number of messages last staged for the lane of the actor,
+ * only the last entry of the outbox is looked at.
+ */
+static uint64_t count_staged_messages(actor_id_t actor, message_lane_t lane) {
+  staged_messages *staged;
+
+  if (local_outbox.number_of_staged == 0)
+    return 0;
+
+  staged = &local_outbox.staged[local_outbox.number_of_staged - 1];
+  return (staged->actor == actor && staged->lane == lane ? staged->number_of_messages : 0);
+}
+
+/* Reserves places for at most n messages in the lane, like
+ * take_places_in_buffer. Messages staged in the outbox get their places
+ * when it is flushed, together with linking them, so now the lane is only
+ * checked as seen with the messages staged right before.
+ */
+long reserve_places_in_buffer(actor_id_t actor, size_t n, message_lane_t *lane, bool may_change_lane,
+                              uint64_t *number_of_messages) {
+  uint64_t waiting;
+
+  if (!is_outbox_open())
+    return take_places_in_buffer(actor, n, lane, may_change_lane, number_of_messages);
+
+  *number_of_messages = atomic_load(&get_actor(actor)->msg_q.number_of_messages);
+  if ((*number_of_messages & ACTOR_DEAD_FLAG) ||
+      *number_of_messages >> GENERATION_SHIFT != get_actor_generation(actor)) {
+    add_to_stat(STAT_ACTOR_DEAD, n);
+    return ACTOR_IS_DEAD;
+  }
+
+  waiting = get_lane_messages(*number_of_messages, *lane) + count_staged_messages(actor, *lane);
+  if (may_change_lane && *lane == LANE_URGENT && waiting >= urgent_queue_limit) {
+    *lane = LANE_NORMAL;
+    waiting = get_lane_messages(*number_of_messages, *lane) + count_staged_messages(actor, *lane);
+  }
+
+  if (waiting >= (*lane == LANE_URGENT ? urgent_queue_limit : actor_queue_limit)) {
+    add_to_stat(STAT_QUEUE_FULL, n);
+    return ACTOR_QUEUE_IS_FULL;
+  }
+
+  waiting = (*lane == LANE_URGENT ? urgent_queue_limit : actor_queue_limit) - waiting;
+  return (long) (waiting < n ? waiting : n);
+}
+
+// Puts n messages, at least one, into nodes linked in order.
+void make_message_nodes(message_t *messages, size_t n, message_node **first, message_node **last) {
+  message_node *node;
+
+  *first = *last = allocate_message_node();
+  (*first)->message = messages[0];
+
+  (*first)->payload = PAYLOAD_POINTER;
+
+  for (size_t i = 1; i < n; i++) {
+    node = allocate_message_node();
+    node->message = messages[i];
+    node->payload = PAYLOAD_POINTER;
+    atomic_store_explicit(&(*last)->next, node, memory_order_relaxed);
+    *last = node;
+  }
+}
+
+// Writes n messages to reserved places in the queue with a single push.
+void write_messages_to_buffer(message_queue *queue, message_t *messages, size_t n) {
+  message_node *first, *last;
+
+  make_message_nodes(messages, n, &first, &last);
+  push_message_nodes(queue, first, last);
+}
+
+/* Delivers n linked nodes to places reserved in the actor`s lane, or
+ * stages them in the outbox while a handler runs. number_of_messages is
+ * the one given by reserve_places_in_buffer. Returns true if the caller has
+ * to make the actor runnable now.
+ */
+bool post_message_nodes(actor_id_t actor, message_lane_t lane, message_node *first, message_node *last, size_t n,
+                        uint64_t number_of_messages) {
+  staged_messages *staged;
+
+  if (!is_outbox_open()) {
+    push_message_nodes(&get_actor(actor)->msg_q.lanes[lane], first, last);
+    return ((number_of_messages & MESSAGES_MASK) == 0);
+  }
+
+  // Messages sent in a row to one lane are simply linked.
+  if (local_outbox.number_of_staged > 0) {
+    staged = &local_outbox.staged[local_outbox.number_of_staged - 1];
+    if (staged->actor == actor && staged->lane == lane) {
+      atomic_store_explicit(&staged->last->next, first, memory_order_relaxed);
+      staged->last = last;
+      staged->number_of_messages += n;
+      return false;
+    }
+  }
+
+  if (local_outbox.number_of_staged == local_outbox.size) {
+    local_outbox.size = (local_outbox.size + 1) * MULTIPLIER / DIVIDER;
+    check_alloc_validity(local_outbox.staged =
+                           realloc(local_outbox.staged, local_outbox.size * sizeof(staged_messages)));
+    check_alloc_validity(local_outbox.runnable =
+                           realloc(local_outbox.runnable, local_outbox.size * sizeof(actor_id_t)));
+  }
+
+  local_outbox.staged[local_outbox.number_of_staged] =
+    (staged_messages) {actor, lane, n, local_outbox.number_of_staged, first, last};
+  local_outbox.number_of_staged++;
+
+  return false;
+}
+
+// Orders staged messages by receiver and lane, then by sending.
+static int compare_staged_messages(const void *a, const void *b) {
+  const staged_messages *x = a, *y = b;
+
+  if (x->actor != y->actor)
+    return (x->actor < y->actor ? -1 : 1);
+  if (x->lane != y->lane)
+    return (x->lane < y->lane ? -1 : 1);
+  return (x->order < y->order ? -1 : x->order > y->order);
+}
+
+// Sorts staged messages, a handler usually stages few of them, which qsort would only slow down.
+static void sort_staged_messages(staged_messages *staged, uint64_t n) {
+  staged_messages key;
+  uint64_t j;
+
+  if (n > OUTBOX_INSERTION_SORT_LIMIT) {
+    qsort(staged, n, sizeof(staged_messages), compare_staged_messages);
+    return;
+  }
+
+  for (uint64_t i = 1; i < n; i++) {
+    key = staged[i];
+    for (j = i; j > 0 && compare_staged_messages(&staged[j - 1], &key) > 0; j--)
+      staged[j] = staged[j - 1];
+    staged[j] = key;
+  }
+}
+
+/* Takes places for n staged nodes linked from first to last and pushes as
+ * many of them as fit. *rest gets the first node left over, *number_of_messages
+ * the number of messages before. Returns the number of places or an error code.
+ */
+static long push_staged_nodes(actor_id_t actor, message_lane_t lane, message_node *first, message_node *last,
+                              uint64_t n, message_node **rest, uint64_t *number_of_messages) {
+  long places = take_places_in_buffer(actor, n, &lane, false, number_of_messages);
+
+  *rest = first;
+  if (places <= 0)
+    return places;
+
+  if ((uint64_t) places < n) {
+    last = first;
+    for (long i = 1; i < places; i++)
+      last = atomic_load_explicit(&last->next, memory_order_relaxed);
+    *rest = atomic_load_explicit(&last->next, memory_order_relaxed);
+  }
+
+  push_message_nodes(&get_actor(actor)->msg_q.lanes[lane], first, last);
+  return places;
+}
+
+/* Delivers n staged nodes sent to one lane of the actor, pushed at once.
+ * Those that do not fit are dropped, except messages sent to the urgent
+ * lane by send_message_to_lane, which try the normal one. Returns true if
+ * the actor has to be made runnable.
+ */
+static bool deliver_staged_nodes(actor_id_t actor, message_lane_t lane, message_node *first, message_node *last,
+                                 uint64_t n) {
+  uint64_t number_of_messages, left, moved = 0;
+  message_node *node, *rest, *moved_first = NULL, *moved_last = NULL;
+  long places;
+  bool makes_runnable;
+
+  places = push_staged_nodes(actor, lane, first, last, n, &rest, &number_of_messages);
+  makes_runnable = (places > 0 && (number_of_messages & MESSAGES_MASK) == 0);
+  left = n - (uint64_t) (places > 0 ? places : 0);
+
+  for (uint64_t i = 0; i < left; i++) {
+    node = rest;
+    rest = atomic_load_explicit(&node->next, memory_order_relaxed);
+
+    // Only messages of send_message_to_lane are in the urgent lane without being control messages.
+    if (lane == LANE_URGENT && places != ACTOR_IS_DEAD &&
+        get_message_lane(node->message.message_type) == LANE_NORMAL) {
+      if (moved++ == 0)
+        moved_first = node;
+      else
+        atomic_store_explicit(&moved_last->next, node, memory_order_relaxed);
+      moved_last = node;
+    } else {
+      release_message(node);
+    }
+  }
+
+  if (moved == 0)
+    return makes_runnable;
+
+  places = push_staged_nodes(actor, LANE_NORMAL, moved_first, moved_last, moved, &rest, &number_of_messages);
+  makes_runnable |= (places > 0 && (number_of_messages & MESSAGES_MASK) == 0);
+  left = moved - (uint64_t) (places > 0 ? places : 0);
+
+  for (uint64_t i = 0; i < left; i++) {
+    node = rest;
+    rest = atomic_load_explicit(&node->next, memory_order_relaxed);
+    release_message(node);
+  }
+
+  return makes_runnable;
+}
+
+/* Delivers messages staged in the outbox of the current thread, with one
+ * reservation and one push for every lane of a receiver, so a receiver
+ * never sees places without nodes. Receivers are made runnable after all
+ * of them are pushed, grouped by threads.
+ */
+void flush_outbox() {
+  staged_messages *staged = local_outbox.staged;
+  uint64_t n = local_outbox.number_of_staged, number_of_runnable = 0, i = 0, j, number_of_messages;
+
+  if (n == 0)
+    return;
+
+  sort_staged_messages(staged, n);
+
+  while (i < n) {
+    number_of_messages = staged[i].number_of_messages;
+    for (j = i + 1; j < n && staged[j].actor == staged[i].actor && staged[j].lane == staged[i].lane; j++) {
+      atomic_store_explicit(&staged[j - 1].last->next, staged[j].first, memory_order_relaxed);
+      number_of_messages += staged[j].number_of_messages;
+    }
+
+    // Only the first place taken in an idle actor makes him runnable, so he is here once.
+    if (deliver_staged_nodes(staged[i].actor, staged[i].lane, staged[i].first, staged[j - 1].last,
+                             number_of_messages))
+      local_outbox.runnable[number_of_runnable++] = staged[i].actor;
+    i = j;
+  }
+
+  local_outbox.number_of_staged = 0;
+
+  if (number_of_runnable == 1)
+    add_actor_to_thread_queue(local_outbox.runnable[0]);
+  else if (number_of_runnable > 1)
+    add_actors_to_thread_queues(local_outbox.runnable, number_of_runnable);
+}
+
+/* Takes the first node from the queue, called only by the reader, whose
+ * head of the queue is *queue_head. Returns NULL if the queue is empty or
+ * a writer has not linked his node yet.
+ */
+message_node *pop_message_node(message_queue *queue, message_node **queue_head) {
+  message_node *head = *queue_head;
+  message_node *next = atomic_load_explicit(&head->next, memory_order_acquire);
+
+  if (head == get_stub(queue)) {
+    // The stub is skipped, it carries no message.
+    if (next == NULL)
+      return NULL;
+
+    *queue_head = head = next;
+    next = atomic_load_explicit(&next->next, memory_order_acquire);
+  }
+
+  if (next != NULL) {
+    *queue_head = next;
+    return head;
+  }
+
+  if (head != atomic_load_explicit(&queue->tail, memory_order_acquire))
+    return NULL;
+
+  // Head is the last node, the stub goes behind it so that head can be given away.
+  push_message_node(queue, get_stub(queue));
+
+  next = atomic_load_explicit(&head->next, memory_order_acquire);
+  if (next != NULL) {
+    *queue_head = next;
+    return head;
+  }
+
+  return NULL;
+}
+
+/* Takes the first message of the actor, from the urgent lane if it has
+ * any, *lane gets the lane. The node is released by the caller after the
+ * message is received, as it may hold the data.
+ */
+message_node *obtain_message(actor_id_t actor, message_lane_t *lane) {
+  // Here I am the only reader of the actor`s buffer and it is not empty.
+  actor_info *info = get_actor(actor);
+  message_node *node;
+
+  *lane = (get_lane_messages(atomic_load(&info->msg_q.number_of_messages), LANE_URGENT) > 0 ? LANE_URGENT : LANE_NORMAL);
+
+  // The writer has already reserved a place, but might not have linked his node yet.
+  while ((node = pop_message_node(&info->msg_q.lanes[*lane], &info->heads[*lane])) == NULL)
+    sched_yield();
+
+  return node;
+}
+
+// Returns payload cache of the current thread, making one if needed.
+static payload_cache *get_payload_cache() {
+  int err;
+  payload_cache *cache;
+
+  if (local_payloads.cache != NULL && local_payloads.generation == message_nodes.generation)
+    return local_payloads.cache;
+
+  // The cache is registered, so it can be freed with the system.
+  check_alloc_validity(cache = calloc(1, sizeof(payload_cache)));
+  for (int i = 0; i < NUMBER_OF_PAYLOAD_CLASSES; i++)
+    atomic_init(&cache->remote_blocks[i], NULL);
+
+  if ((err = pthread_mutex_lock(&message_nodes.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  cache->next = payload_caches;
+  payload_caches = cache;
+
+  if ((err = pthread_mutex_unlock(&message_nodes.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_unlock");
+
+  local_payloads.cache = cache;
+  local_payloads.generation = message_nodes.generation;
+
+  return cache;
+}
+
+// Carves a new chunk into free blocks of the size class.
+static void add_payload_chunk(payload_cache *cache, uint64_t size_class) {
+  uint64_t block_size = PAYLOAD_MIN_BLOCK << size_class;
+  unsigned char *chunk;
+  payload_header *block;
+
+  if (cache->number_of_chunks == cache->chunks_size) {
+    cache->chunks_size = (cache->chunks_size + 1) * MULTIPLIER / DIVIDER;
+    check_alloc_validity(cache->chunks = realloc(cache->chunks, cache->chunks_size * sizeof(void *)));
+  }
+  check_alloc_validity(chunk = malloc(PAYLOAD_CHUNK_SIZE));
+  cache->chunks[cache->number_of_chunks++] = chunk;
+
+  for (uint64_t offset = PAYLOAD_CHUNK_SIZE; offset >= block_size; offset -= block_size) {
+    block = (payload_header *) (chunk + offset - block_size);
+    block->owner = cache;
+    block->next = cache->free_blocks[size_class];
+    cache->free_blocks[size_class] = block;
+  }
+}
+
+/* Allocates a block for nbytes of message data, from the current thread`s
+ * slabs if it fits into the largest size class.
+ */
+void *allocate_payload(size_t nbytes) {
+  payload_cache *cache;
+  payload_header *block;
+  uint64_t size_class = 0;
+
+  if (nbytes > (PAYLOAD_MIN_BLOCK << (NUMBER_OF_PAYLOAD_CLASSES - 1)) - sizeof(payload_header)) {
+    check_alloc_validity(block = malloc(sizeof(payload_header) + nbytes));
+    block->owner = NULL;
+    return block + 1;
+  }
+
+  while ((PAYLOAD_MIN_BLOCK << size_class) - sizeof(payload_header) < nbytes)
+    size_class++;
+
+  cache = get_payload_cache();
+
+  // Blocks freed by other threads are taken all at once.
+  if (cache->free_blocks[size_class] == NULL)
+    cache->free_blocks[size_class] = atomic_exchange(&cache->remote_blocks[size_class], NULL);
+  if (cache->free_blocks[size_class] == NULL)
+    add_payload_chunk(cache, size_class);
+
+  block = cache->free_blocks[size_class];
+  cache->free_blocks[size_class] = block->next;
+  block->size_class = size_class;
+
+  return block + 1;
+}
+
+// Gives a payload block back to the thread it comes from.
+void release_payload(void *data) {
+  payload_header *block = (payload_header *) data - 1;
+  payload_cache *owner = block->owner;
+  uint64_t size_class;
+
+  if (owner == NULL) {
+    free(block);
+    return;
+  }
+
+  size_class = block->size_class;
+  if (owner == local_payloads.cache && local_payloads.generation == message_nodes.generation) {
+    block->next = owner->free_blocks[size_class];
+    owner->free_blocks[size_class] = block;
+    return;
+  }
+
+  // The owner takes the whole list at once, so there is no ABA problem.
+  block->next = atomic_load_explicit(&owner->remote_blocks[size_class], memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(&owner->remote_blocks[size_class], &block->next, block,
+                                                memory_order_release, memory_order_relaxed))
+    ;
+}
+
+// Allocates a payload block for nbytes of data shared by many messages, with one reference.
+void *allocate_shared_payload(size_t nbytes) {
+  shared_header *header = allocate_payload(sizeof(shared_header) + nbytes);
+
+  atomic_init(&header->references, 1);
+
+  return header + 1;
+}
+
+// Adds n references to a shared payload, someone has to hold one already.
+void retain_shared_payload(void *data, uint64_t n) {
+  atomic_fetch_add_explicit(&((shared_header *) data - 1)->references, n, memory_order_relaxed);
+}
+
+// Drops n references to a shared payload, the last one frees it.
+void release_shared_payload(void *data, uint64_t n) {
+  shared_header *header = (shared_header *) data - 1;
+
+  // Writes made through other references happen before the block is reused.
+  if (atomic_fetch_sub_explicit(&header->references, n, memory_order_acq_rel) == n)
+    release_payload(header);
+}
+
+/* Puts n actors at the back of the thread`s queue. Returns true if the
+ * thread was asleep and has been woken up. If number_of_actors is not
+ * NULL, it gets the number of actors in the queue after the push.
+ */
+bool push_actors_to_queue(actor_id_t *actors, uint64_t n, uint32_t thread_number, uint64_t *number_of_actors) {
+  int err;
+  bool was_thread_sleeping;
+
+  // Acquiring access to thread`s queue.
+  if ((err = pthread_mutex_lock(&actor_q[thread_number].lock)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  adjust_size_of_queue(&actor_q[thread_number], n);
+
+  // Now there must be enough place for n more actor_id_t.
+  for (uint64_t i = 0; i < n; i++) {
+    trace_event_if_tracing(TRACE_RUNNABLE, actors[i], thread_number, 0);
+    actor_q[thread_number].actor_id[actor_q[thread_number].writepos] = actors[i];
+    actor_q[thread_number].writepos =
+      (actor_q[thread_number].writepos + 1) % actor_q[thread_number].size;
+  }
+  actor_q[thread_number].number_of_actors += n;
+#if CACTI_STATS
+  if (actor_q[thread_number].number_of_actors > actor_q[thread_number].high_water)
+    actor_q[thread_number].high_water = actor_q[thread_number].number_of_actors;
+#endif
+
+  if (number_of_actors != NULL)
+    *number_of_actors = actor_q[thread_number].number_of_actors;
+
+  // The flag is set under the lock, so if it is, the thread is waiting on cond.
+  was_thread_sleeping = atomic_load(&actor_q[thread_number].is_sleeping);
+
+  // Returning access to the queue.
+  if ((err = pthread_mutex_unlock(&actor_q[thread_number].lock)) != 0)
+    handle_error_en(err, "pthread_mutex_unlock");
+
+  /* The thread is asleep, we have to wake it up. Signalling after unlocking
+   * lets it take the lock at once.
+   */
+  if (was_thread_sleeping) {
+    if ((err = pthread_cond_signal(&cond[thread_number])) != 0)
+      handle_error_en(err, "pthread_cond_signal");
+  }
+
+  return was_thread_sleeping;
+}
+
+bool push_actor_to_queue(actor_id_t actor, uint32_t thread_number, uint64_t *number_of_actors) {
+  return push_actors_to_queue(&actor, 1, thread_number, number_of_actors);
+}
+
+// Takes an actor from the front of the thread`s own queue.
+bool pop_actor_from_queue(actor_id_t *actor, uint32_t thread_number) {
+  int err;
+  bool is_queue_empty;
+
+  // Acquiring access to thread`s queue.
+  if ((err = pthread_mutex_lock(&actor_q[thread_number].lock)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  is_queue_empty = (actor_q[thread_number].number_of_actors == 0);
+  if (!is_queue_empty) {
+    *actor = actor_q[thread_number].actor_id[actor_q[thread_number].readpos];
+    actor_q[thread_number].readpos =
+      (actor_q[thread_number].readpos + 1) % actor_q[thread_number].size;
+    actor_q[thread_number].number_of_actors--;
+  }
+
+  // Returning access to the queue.
+  if ((err = pthread_mutex_unlock(&actor_q[thread_number].lock)) != 0)
+    handle_error_en(err, "pthread_mutex_unlock");
+
+  return !is_queue_empty;
+}
+
+// Takes an actor from the back of some other thread`s queue.
+bool steal_actor_from_other_queue(actor_id_t *actor, uint32_t thread_number) {
+  int err;
+  bool is_stolen = false, is_overloaded = false;
+
+  for (uint32_t i = 1; i < pool_size && !is_stolen; i++) {
+    uint32_t victim = (thread_number + i) % pool_size;
+
+    // Acquiring access to victim`s queue.
+    if ((err = pthread_mutex_lock(&actor_q[victim].lock)) != 0)
+      handle_error_en(err, "pthread_mutex_lock");
+
+    if (actor_q[victim].number_of_actors > 0) {
+      // The victim has more than it can handle soon, the actor moves for good.
+      is_overloaded = (actor_q[victim].number_of_actors >= MIGRATION_QUEUE_LENGTH);
+      actor_q[victim].writepos =
+        (actor_q[victim].writepos + actor_q[victim].size - 1) % actor_q[victim].size;
+      *actor = actor_q[victim].actor_id[actor_q[victim].writepos];
+      actor_q[victim].number_of_actors--;
+      is_stolen = true;
+    }
+
+    // Returning access to the queue.
+    if ((err = pthread_mutex_unlock(&actor_q[victim].lock)) != 0)
+      handle_error_en(err, "pthread_mutex_unlock");
+  }
+
+  if (is_stolen)
+    add_to_stat(STAT_STEALS, 1);
+  if (is_stolen && is_overloaded && MIGRATION_VOTES > 0)
+    atomic_store_explicit(&get_actor(*actor)->home_thread, thread_number, memory_order_relaxed);
+
+  return is_stolen;
+}
+
+// Wakes up one sleeping thread other than the given one, so it can steal work.
+void wake_up_idle_thread(uint32_t thread_number) {
+  int err;
+
+  for (uint32_t i = 1; i < pool_size; i++) {
+    uint32_t idle = (thread_number + i) % pool_size;
+
+    if (!atomic_load(&actor_q[idle].is_sleeping))
+      continue;
+
+    if ((err = pthread_mutex_lock(&actor_q[idle].lock)) != 0)
+      handle_error_en(err, "pthread_mutex_lock");
+
+    if (atomic_load(&actor_q[idle].is_sleeping)) {
+      if ((err = pthread_cond_signal(&cond[idle])) != 0)
+        handle_error_en(err, "pthread_cond_signal");
+    }
+
+    if ((err = pthread_mutex_unlock(&actor_q[idle].lock)) != 0)
+      handle_error_en(err, "pthread_mutex_unlock");
+
+    break;
+  }
+}
+
+/* Makes n actors with the same home thread runnable. If that thread is
+ * busy, an idle one is woken up to steal them, unless some thread is
+ * already spinning. Nobody is told of a lone actor that the current thread
+ * takes next, after the turn of its actor.
+ */
+void add_actors_to_thread_queue(actor_id_t *actors, uint64_t n, uint32_t thread_number) {
+  uint64_t number_of_actors;
+
+  if (!push_actors_to_queue(actors, n, thread_number, &number_of_actors)) {
+    if (is_turn_ending && thread_number == current_thread_number && number_of_actors <= 1)
+      return;
+
+    atomic_fetch_add(&queue_epoch.value, 1);
+
+    // A spinning thread notices the new epoch by itself.
+    if (atomic_load(&number_of_spinning_threads.value) == 0)
+      wake_up_idle_thread(thread_number);
+  }
+}
+
+// Returns the group of an actor made runnable: his home thread, or pool_size for the blocking pool.
+static uint32_t get_runnable_group(actor_id_t actor) {
+  return (get_actor(actor)->is_blocking ? pool_size : get_home_thread(actor));
+}
+
+/* Makes a vector of the current thread`s scratch hold at least n elements.
+ * Its contents are not kept.
+ */
+static void *reserve_scratch(void *vector, uint64_t *size, uint64_t n, size_t element_size) {
+  uint64_t new_size = *size;
+
+  if (n <= *size)
+    return vector;
+
+  while (n > new_size)
+    new_size = (new_size + 1) * MULTIPLIER / DIVIDER;
+
+  free(vector);
+  check_alloc_validity(vector = malloc(new_size * element_size));
+  *size = new_size;
+
+  return vector;
+}
+
+/* Returns a vector of the current thread for n actors, which a broadcast
+ * makes runnable. It is valid until the next call by the thread.
+ */
+actor_id_t *get_runnable_scratch(uint64_t n) {
+  local_scratch.runnable = reserve_scratch(local_scratch.runnable, &local_scratch.runnable_size, n,
+                                           sizeof(actor_id_t));
+
+  return local_scratch.runnable;
+}
+
+// Frees the current thread`s scratch, called by threads of the system before they finish.
+void free_thread_scratch() {
+  free(local_scratch.begin);
+  free(local_scratch.grouped);
+  free(local_scratch.runnable);
+  local_scratch.begin = NULL;
+  local_scratch.grouped = local_scratch.runnable = NULL;
+  local_scratch.begin_size = local_scratch.grouped_size = local_scratch.runnable_size = 0;
+}
+
+/* Makes n actors runnable, grouped by their home threads, so every thread
+ * is taken care of once.
+ */
+void add_actors_to_thread_queues(actor_id_t *actors, uint64_t n) {
+  uint64_t *begin;
+  actor_id_t *grouped;
+
+  // Vectors of the thread, so that making actors runnable allocates nothing once they are long enough.
+  begin = local_scratch.begin = reserve_scratch(local_scratch.begin, &local_scratch.begin_size, pool_size + 2,
+                                                sizeof(uint64_t));
+  grouped = local_scratch.grouped = reserve_scratch(local_scratch.grouped, &local_scratch.grouped_size, n,
+                                                    sizeof(actor_id_t));
+  memset(begin, 0, (pool_size + 2) * sizeof(uint64_t));
+
+  // Counting sort by the home thread, blocking actors go last.
+  for (uint64_t i = 0; i < n; i++) {
+    if (!get_actor(actors[i])->is_blocking)
+      sample_sender_thread(actors[i]);
+    begin[get_runnable_group(actors[i]) + 1]++;
+  }
+  for (uint32_t i = 0; i <= pool_size; i++)
+    begin[i + 1] += begin[i];
+
+  for (uint64_t i = 0; i < n; i++)
+    grouped[begin[get_runnable_group(actors[i])]++] = actors[i];
+
+  // Now begin[i] is where the group of thread i ends.
+  for (uint32_t i = 0; i <= pool_size; i++) {
+    uint64_t group_begin = (i == 0 ? 0 : begin[i - 1]);
+
+    if (begin[i] == group_begin)
+      continue;
+    if (i == pool_size)
+      push_blocking_actors(grouped + group_begin, begin[i] - group_begin);
+    else
+      add_actors_to_thread_queue(grouped + group_begin, begin[i] - group_begin, i);
+  }
+}
+
+/* Makes an actor runnable. It goes to its home thread, if that thread is
+ * busy, an idle one is woken up to steal it.
+ */
+void add_actor_to_thread_queue(actor_id_t actor) {
+  if (get_actor(actor)->is_blocking) {
+    push_blocking_actors(&actor, 1);
+  } else {
+    sample_sender_thread(actor);
+    add_actors_to_thread_queue(&actor, 1, get_home_thread(actor));
+  }
+}
+
+// Joins blocking threads that have ended for being idle, the pool`s lock is held.
+static void join_retired_blocking_threads() {
+  int err;
+
+  for (uint64_t i = 0; i < blocking_threads.number_of_retired; i++)
+    if ((err = pthread_join(blocking_threads.retired[i], 0)) != 0)
+      handle_error_en(err, "pthread_join");
+  blocking_threads.number_of_retired = 0;
+}
+
+/* Takes the calling thread out of the blocking pool, so it can end. The
+ * pool`s lock is held.
+ */
+static void retire_blocking_thread() {
+  pthread_t self = pthread_self();
+
+  for (uint64_t i = 0; i < blocking_threads.number_of_threads; i++) {
+    if (pthread_equal(blocking_threads.threads[i], self)) {
+      blocking_threads.threads[i] = blocking_threads.threads[--blocking_threads.number_of_threads];
+      break;
+    }
+  }
+
+  if (blocking_threads.number_of_retired == blocking_threads.retired_size) {
+    blocking_threads.retired_size = (blocking_threads.retired_size + 1) * MULTIPLIER / DIVIDER;
+    check_alloc_validity(blocking_threads.retired =
+                           realloc(blocking_threads.retired, blocking_threads.retired_size * sizeof(pthread_t)));
+  }
+  blocking_threads.retired[blocking_threads.number_of_retired++] = self;
+}
+
+/* Puts n blocking actors to the queue of the blocking pool, waking up idle
+ * threads and starting new ones for actors that no idle thread takes.
+ */
+void push_blocking_actors(actor_id_t *actors, uint64_t n) {
+  int err;
+  actor_buffer *q = &blocking_threads.queue;
+  uint64_t woken;
+
+  if ((err = pthread_mutex_lock(&q->lock)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  adjust_size_of_queue(q, n);
+
+  for (uint64_t i = 0; i < n; i++) {
+    q->actor_id[q->writepos] = actors[i];
+    q->writepos = (q->writepos + 1) % q->size;
+  }
+  q->number_of_actors += n;
+#if CACTI_STATS
+  if (q->number_of_actors > q->high_water)
+    q->high_water = q->number_of_actors;
+#endif
+
+  woken = (n < blocking_threads.number_of_idle_threads ? n : blocking_threads.number_of_idle_threads);
+  for (uint64_t i = 0; i < woken; i++)
+    if ((err = pthread_cond_signal(&blocking_threads.cond)) != 0)
+      handle_error_en(err, "pthread_cond_signal");
+
+  // Threads that have ended do not pile up, while the pool grows and shrinks.
+  join_retired_blocking_threads();
+
+  // Busy threads take the rest after their actors, unless more threads can be started.
+  for (uint64_t i = woken; i < n && blocking_threads.number_of_threads < blocking_threads.limit; i++) {
+    if (blocking_threads.number_of_threads == blocking_threads.threads_size) {
+      blocking_threads.threads_size = (blocking_threads.threads_size + 1) * MULTIPLIER / DIVIDER;
+      check_alloc_validity(blocking_threads.threads =
+                             realloc(blocking_threads.threads, blocking_threads.threads_size * sizeof(pthread_t)));
+    }
+
+    if ((err = pthread_create(&blocking_threads.threads[blocking_threads.number_of_threads], &blocking_threads.attr,
+                              blocking_thread_task, NULL)) != 0)
+      handle_error_en(err, "pthread_create");
+    blocking_threads.number_of_threads++;
+  }
+
+  if ((err = pthread_mutex_unlock(&q->lock)) != 0)
+    handle_error_en(err, "pthread_mutex_unlock");
+}
+
+// Code of threads of the blocking pool.
+void *blocking_thread_task(void *data) {
+  (void) data;
+  int err;
+  actor_buffer *q = &blocking_threads.queue;
+  actor_id_t actor_with_message;
+  uint64_t timeout_ns;
+  struct timespec ts;
+
+  if ((err = pthread_mutex_lock(&q->lock)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  while (!is_system_dead()) {
+    if (q->number_of_actors == 0) {
+      timeout_ns = get_time_ns() + (uint64_t) BLOCKING_IDLE_TIMEOUT_US * 1000;
+      ts.tv_sec = timeout_ns / 1000000000;
+      ts.tv_nsec = timeout_ns % 1000000000;
+
+      blocking_threads.number_of_idle_threads++;
+      if ((err = pthread_cond_timedwait(&blocking_threads.cond, &q->lock, &ts)) != 0 && err != ETIMEDOUT)
+        handle_error_en(err, "pthread_cond_timedwait");
+      blocking_threads.number_of_idle_threads--;
+
+      // The thread ends after being idle for the whole timeout, unless the pool would be too small.
+      if (err == ETIMEDOUT && q->number_of_actors == 0 && !is_system_dead() &&
+          blocking_threads.number_of_threads > BLOCKING_POOL_MIN) {
+        retire_blocking_thread();
+        break;
+      }
+      continue;
+    }
+
+    actor_with_message = q->actor_id[q->readpos];
+    q->readpos = (q->readpos + 1) % q->size;
+    q->number_of_actors--;
+
+    if ((err = pthread_mutex_unlock(&q->lock)) != 0)
+      handle_error_en(err, "pthread_mutex_unlock");
+
+    actor_receive_message(actor_with_message, BLOCKING_THREAD_NUMBER);
+
+    if ((err = pthread_mutex_lock(&q->lock)) != 0)
+      handle_error_en(err, "pthread_mutex_lock");
+  }
+
+  if ((err = pthread_mutex_unlock(&q->lock)) != 0)
+    handle_error_en(err, "pthread_mutex_unlock");
+
+  free_thread_scratch();
+
+  return NULL;
+}
+
+/* Waits for all threads of the blocking pool, none is started or ends for
+ * being idle once the system is dead.
+ */
+void join_blocking_threads() {
+  int err;
+
+  for (uint64_t i = 0; i < blocking_threads.number_of_threads; i++)
+    if ((err = pthread_join(blocking_threads.threads[i], 0)) != 0)
+      handle_error_en(err, "pthread_join");
+  join_retired_blocking_threads();
+}
+
+// Code that pool_size threads have to execute.
+void *thread_task(void *data) {
+  uint32_t thread_number = *(uint32_t *) (data);
+  actor_id_t actor_with_message;
+
+#if CACTI_STATS
+  current_thread_stats = &stats_of_threads[thread_number];
+#endif
+  current_thread_number = thread_number;
+#if CACTI_TRACE
+  current_trace_buffer = (trace_buffers != NULL ? &trace_buffers[thread_number] : NULL);
+#endif
+
+  while (true) {
+    if (is_system_dead())
+      break;
+
+    // Here the thread gets an actor with at least one message.
+    if (!get_actor_to_receive_message(&actor_with_message, thread_number))
+      break;
+
+    actor_receive_message(actor_with_message, thread_number);
+  }
+
+  free(local_outbox.staged);
+  free(local_outbox.runnable);
+  free_thread_scratch();
+  free(data);
+
+  return NULL;
+}
+
+/* Puts a pending entry into the slot given by its expiry, relative to the
+ * current tick. Called with the wheel`s lock.
+ */
+static void insert_timer(int64_t index) {
+  timer_entry *entry = &timers.entries[index];
+  // A timer already due goes to the current tick.
+  uint64_t expires = (entry->expires > timers.current ? entry->expires : timers.current);
+  uint64_t group, current_group;
+  int level = 0, slot;
+
+  // The lowest level where the expiry and the current tick are in the same slot of the next level.
+  while (level < TIMER_LEVELS - 1 &&
+         expires >> (TIMER_SLOT_BITS * (level + 1)) != timers.current >> (TIMER_SLOT_BITS * (level + 1)))
+    level++;
+
+  group = expires >> (TIMER_SLOT_BITS * level);
+  current_group = timers.current >> (TIMER_SLOT_BITS * level);
+  if (group - current_group < TIMER_SLOTS)
+    slot = level * TIMER_SLOTS + group % TIMER_SLOTS;
+  else
+    // Too far for the wheel, the timer waits in the last slot reached before it wraps around.
+    slot = level * TIMER_SLOTS + (current_group + TIMER_SLOTS - 1) % TIMER_SLOTS;
+
+  entry->slot = slot;
+  entry->prev = -1;
+  entry->next = timers.slots[slot];
+  if (entry->next != -1)
+    timers.entries[entry->next].prev = index;
+  timers.slots[slot] = index;
+}
+
+// Takes a pending entry out of its slot. Called with the wheel`s lock.
+static void unlink_timer(int64_t index) {
+  timer_entry *entry = &timers.entries[index];
+
+  if (entry->prev != -1)
+    timers.entries[entry->prev].next = entry->next;
+  else
+    timers.slots[entry->slot] = entry->next;
+  if (entry->next != -1)
+    timers.entries[entry->next].prev = entry->prev;
+}
+
+// Puts an unlinked entry to the free list, its id stops being valid. Called with the wheel`s lock.
+static void free_timer(int64_t index) {
+  timer_entry *entry = &timers.entries[index];
+
+  entry->generation = (entry->generation + 1) % ((uint64_t) 1 << TIMER_GENERATION_BITS);
+  entry->slot = -1;
+  entry->next = timers.free_entries;
+  timers.free_entries = index;
+  timers.number_of_pending--;
+}
+
+// Returns id of an entry.
+static timer_id_t get_timer_id(int64_t index) {
+  return (timer_id_t) (timers.entries[index].generation << ACTOR_INDEX_BITS | (uint64_t) index);
+}
+
+/* Processes the current tick: timers of higher levels whose slot has come
+ * move down, then timers of the tick go to the fired ones. Periodic timers
+ * are put back. Called with the wheel`s lock by the timer thread.
+ */
+static void process_tick() {
+  uint64_t tick = timers.current;
+  int64_t index, next;
+  int slot;
+
+  for (int level = TIMER_LEVELS - 1; level > 0; level--) {
+    if (tick % ((uint64_t) 1 << (TIMER_SLOT_BITS * level)) != 0)
+      continue;
+
+    slot = level * TIMER_SLOTS + (tick >> (TIMER_SLOT_BITS * level)) % TIMER_SLOTS;
+    index = timers.slots[slot];
+    timers.slots[slot] = -1;
+    for (; index != -1; index = next) {
+      next = timers.entries[index].next;
+      insert_timer(index);
+    }
+  }
+
+  slot = tick % TIMER_SLOTS;
+  index = timers.slots[slot];
+  timers.slots[slot] = -1;
+  for (; index != -1; index = next) {
+    timer_entry *entry = &timers.entries[index];
+
+    next = entry->next;
+    if (timers.number_of_fired == timers.fired_size) {
+      timers.fired_size = (timers.fired_size + 1) * MULTIPLIER / DIVIDER;
+      check_alloc_validity(timers.fired = realloc(timers.fired, timers.fired_size * sizeof(fired_timer)));
+      check_alloc_validity(timers.runnable = realloc(timers.runnable, timers.fired_size * sizeof(actor_id_t)));
+    }
+    timers.fired[timers.number_of_fired++] = (fired_timer) {get_timer_id(index), entry->actor, entry->message};
+
+    if (entry->period > 0) {
+      // A late period is not made up for, the next expiry is still in the future.
+      entry->expires = (entry->expires + entry->period > tick ? entry->expires + entry->period : tick + 1);
+      insert_timer(index);
+    } else {
+      free_timer(index);
+    }
+  }
+
+  timers.current++;
+}
+
+/* Returns the tick the timer thread has to wake up at: the next tick with
+ * timers in the lowest level or the next move of higher levels.
+ */
+static uint64_t get_next_tick() {
+  uint64_t first_of_group = timers.current - timers.current % TIMER_SLOTS;
+
+  for (uint64_t tick = timers.current; tick < first_of_group + TIMER_SLOTS; tick++)
+    if (timers.slots[tick % TIMER_SLOTS] != -1)
+      return tick;
+
+  return first_of_group + TIMER_SLOTS;
+}
+
+/* Sends messages of the fired timers, making their receivers runnable all
+ * at once. Timers of dead actors are cancelled.
+ */
+static void deliver_fired_timers() {
+  uint64_t number_of_messages, number_of_runnable = 0;
+  actor_id_t receiver;
+  message_lane_t lane;
+  long places;
+
+  for (uint64_t i = 0; i < timers.number_of_fired; i++) {
+    fired_timer *fired = &timers.fired[i];
+
+    // Every message of a timer of a router is routed on its own.
+    receiver = route_message(fired->actor, NULL);
+    lane = get_message_lane(fired->message.message_type);
+    places = reserve_places_in_buffer(receiver, 1, &lane, false, &number_of_messages);
+    if (places > 0) {
+      write_messages_to_buffer(&get_actor(receiver)->msg_q.lanes[lane], &fired->message, 1);
+
+      if ((number_of_messages & MESSAGES_MASK) == 0)
+        timers.runnable[number_of_runnable++] = receiver;
+    } else if (places == ACTOR_IS_DEAD && receiver == fired->actor) {
+      remove_timer(fired->id);
+    }
+  }
+  timers.number_of_fired = 0;
+
+  if (number_of_runnable > 0)
+    add_actors_to_thread_queues(timers.runnable, number_of_runnable);
+}
+
+// Code of the timer thread, it processes ticks as they pass until the system is dead.
+void *timer_task(void *data) {
+  (void) data;
+  int err;
+  uint64_t now, wake_ns;
+  struct timespec ts;
+
+  if ((err = pthread_mutex_lock(&timers.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  while (!is_system_dead()) {
+    now = (get_time_ns() - timers.start_ns) / timers.tick_ns;
+
+    // An empty wheel has nothing to process, its ticks are skipped.
+    if (timers.number_of_pending == 0 && timers.current <= now)
+      timers.current = now + 1;
+    while (timers.current <= now)
+      process_tick();
+
+    if (timers.number_of_fired > 0) {
+      // Messages are sent without the lock, timers can be added meanwhile.
+      if ((err = pthread_mutex_unlock(&timers.lock)) != 0)
+        handle_error_en(err, "pthread_mutex_unlock");
+
+      deliver_fired_timers();
+
+      if ((err = pthread_mutex_lock(&timers.lock)) != 0)
+        handle_error_en(err, "pthread_mutex_lock");
+      continue;
+    }
+
+    if (timers.number_of_pending == 0) {
+      timers.wake_tick = UINT64_MAX;
+      if ((err = pthread_cond_wait(&timers.cond, &timers.lock)) != 0)
+        handle_error_en(err, "pthread_cond_wait");
+    } else {
+      timers.wake_tick = get_next_tick();
+      wake_ns = timers.start_ns + timers.wake_tick * timers.tick_ns;
+      ts.tv_sec = wake_ns / 1000000000;
+      ts.tv_nsec = wake_ns % 1000000000;
+      if ((err = pthread_cond_timedwait(&timers.cond, &timers.lock, &ts)) != 0 && err != ETIMEDOUT)
+        handle_error_en(err, "pthread_cond_timedwait");
+    }
+  }
+
+  if ((err = pthread_mutex_unlock(&timers.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_unlock");
+
+  free_thread_scratch();
+
+  return NULL;
+}
+
+/* Adds a timer sending the message to the actor after delay_ns and then
+ * every period_ns, unless it is 0. Starts the timer thread with the first
+ * timer. Returns id of the timer.
+ */
+timer_id_t add_timer(actor_id_t actor, message_t message, uint64_t delay_ns, uint64_t period_ns) {
+  int err;
+  int64_t index;
+  timer_entry *entry;
+  timer_id_t id;
+
+  if ((err = pthread_mutex_lock(&timers.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  if (timers.free_entries != -1) {
+    index = timers.free_entries;
+    timers.free_entries = timers.entries[index].next;
+  } else {
+    if (timers.number_of_entries == timers.entries_size) {
+      timers.entries_size = (timers.entries_size + 1) * MULTIPLIER / DIVIDER;
+      check_alloc_validity(timers.entries = realloc(timers.entries, timers.entries_size * sizeof(timer_entry)));
+    }
+    index = timers.number_of_entries++;
+    timers.entries[index].generation = 0;
+  }
+
+  entry = &timers.entries[index];
+  entry->actor = actor;
+  entry->message = message;
+  // Rounded up, so the message never comes too early.
+  entry->expires = (get_time_ns() + delay_ns - timers.start_ns + timers.tick_ns - 1) / timers.tick_ns;
+  entry->period = (period_ns + timers.tick_ns - 1) / timers.tick_ns;
+  if (period_ns > 0 && entry->period == 0)
+    entry->period = 1;
+  insert_timer(index);
+  timers.number_of_pending++;
+  id = get_timer_id(index);
+
+  if (!timers.is_thread_running) {
+    // The timer thread is set up like threads of the blocking pool.
+    if ((err = pthread_create(&timers.thread, &blocking_threads.attr, timer_task, NULL)) != 0)
+      handle_error_en(err, "pthread_create");
+    timers.is_thread_running = true;
+  } else if (entry->expires < timers.wake_tick) {
+    // The timer thread sleeps longer than this timer waits.
+    if ((err = pthread_cond_signal(&timers.cond)) != 0)
+      handle_error_en(err, "pthread_cond_signal");
+  }
+
+  if ((err = pthread_mutex_unlock(&timers.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_unlock");
+
+  return id;
+}
+
+// Cancels a pending timer. Returns false if there is no such timer.
+bool remove_timer(timer_id_t timer) {
+  int err;
+  uint64_t index = get_actor_index(timer);
+  bool is_pending;
+
+  if ((err = pthread_mutex_lock(&timers.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  is_pending = (timer >= 0 && index < timers.number_of_entries && timers.entries[index].slot != -1 &&
+                timers.entries[index].generation == (uint64_t) timer >> ACTOR_INDEX_BITS);
+  if (is_pending) {
+    unlink_timer(index);
+    free_timer(index);
+  }
+
+  if ((err = pthread_mutex_unlock(&timers.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_unlock");
+
+  return is_pending;
+}
+
+// Waits for the timer thread, if it has been started.
+void join_timer_thread() {
+  int err;
+
+  if (timers.is_thread_running && (err = pthread_join(timers.thread, 0)) != 0)
+    handle_error_en(err, "pthread_join");
+}
+
+// Returns a request slot with a valid index.
+static request_slot *get_request_slot(uint64_t index) {
+  return &requests.chunks[index / REQUESTS_CHUNK_SIZE][index % REQUESTS_CHUNK_SIZE];
+}
+
+// Returns the slot of a request that is not free, NULL if there is none. Called with the table`s lock.
+static request_slot *find_request(request_id_t request) {
+  uint64_t index = get_actor_index(request);
+  request_slot *slot;
+
+  if (request < 0 || index >= requests.number_of_slots)
+    return NULL;
+
+  slot = get_request_slot(index);
+  if (slot->state == REQUEST_FREE || slot->generation != (uint64_t) request >> ACTOR_INDEX_BITS)
+    return NULL;
+
+  return slot;
+}
+
+// Puts a slot to the free list, its id stops being valid. Called with the table`s lock.
+static void free_request_slot(request_id_t request) {
+  uint64_t index = get_actor_index(request);
+  request_slot *slot = get_request_slot(index);
+
+  slot->state = REQUEST_FREE;
+  slot->generation = (slot->generation + 1) % ((uint64_t) 1 << (63 - ACTOR_INDEX_BITS));
+  slot->next_free = requests.free_slots;
+  requests.free_slots = index;
+}
+
+/* Takes a slot for a request with the message`s data, the reply goes to
+ * the requester or waits for wait_for_reply if it is ACTOR_ID_NONE.
+ * Returns the request with its handle filled in.
+ */
+cacti_request_t *open_request(actor_id_t requester, message_type_t reply_type, message_t message) {
+  int err;
+  uint64_t index;
+  request_slot *slot;
+
+  if ((err = pthread_mutex_lock(&requests.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  if (requests.free_slots != -1) {
+    index = requests.free_slots;
+    requests.free_slots = get_request_slot(index)->next_free;
+  } else {
+    if (requests.number_of_slots == requests.number_of_chunks * REQUESTS_CHUNK_SIZE) {
+      if (requests.number_of_chunks == requests.chunks_size) {
+        requests.chunks_size = (requests.chunks_size + 1) * MULTIPLIER / DIVIDER;
+        check_alloc_validity(requests.chunks = realloc(requests.chunks, requests.chunks_size * sizeof(request_slot *)));
+      }
+      check_alloc_validity(requests.chunks[requests.number_of_chunks++] =
+                             malloc(REQUESTS_CHUNK_SIZE * sizeof(request_slot)));
+    }
+    index = requests.number_of_slots++;
+    get_request_slot(index)->generation = 0;
+  }
+
+  slot = get_request_slot(index);
+  slot->request.reply_to = (request_id_t) (slot->generation << ACTOR_INDEX_BITS | index);
+  slot->request.nbytes = message.nbytes;
+  slot->request.data = message.data;
+  slot->requester = requester;
+  slot->reply_type = reply_type;
+  slot->state = REQUEST_PENDING;
+  slot->is_waited = false;
+
+  if ((err = pthread_mutex_unlock(&requests.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_unlock");
+
+  return &slot->request;
+}
+
+// Frees the slot of a request that could not be sent.
+void cancel_request(request_id_t request) {
+  int err;
+
+  if ((err = pthread_mutex_lock(&requests.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  free_request_slot(request);
+
+  if ((err = pthread_mutex_unlock(&requests.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_unlock");
+}
+
+/* Completes a pending request in place: the reply is sent to the requester
+ * or kept for wait_for_reply. Returns false if there is no such request.
+ */
+bool complete_request(request_id_t request, size_t nbytes, void *data) {
+  int err;
+  request_slot *slot;
+  actor_id_t requester = ACTOR_ID_NONE;
+  message_t reply = {0, nbytes, data};
+  bool is_pending;
+
+  if ((err = pthread_mutex_lock(&requests.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  slot = find_request(request);
+  is_pending = (slot != NULL && slot->state == REQUEST_PENDING);
+  if (is_pending) {
+    if (slot->requester != ACTOR_ID_NONE) {
+      // The slot is not needed anymore, the reply goes as a message.
+      requester = slot->requester;
+      reply.message_type = slot->reply_type;
+      free_request_slot(request);
+    } else {
+      slot->reply = reply;
+      slot->state = REQUEST_REPLIED;
+      if (slot->is_waited && (err = pthread_cond_broadcast(&requests.cond)) != 0)
+        handle_error_en(err, "pthread_cond_broadcast");
+    }
+  }
+
+  if ((err = pthread_mutex_unlock(&requests.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_unlock");
+
+  if (requester != ACTOR_ID_NONE)
+    send_message(requester, reply);
+
+  return is_pending;
+}
+
+/* Waits until a request waited for is replied and frees it. Returns false
+ * if there is no such request or the system is dead before the reply.
+ */
+bool wait_for_request(request_id_t request, message_t *reply) {
+  int err;
+  request_slot *slot;
+  bool is_replied = false;
+
+  // A handler waiting for a reply would otherwise hold back his own request.
+  flush_outbox();
+
+  if ((err = pthread_mutex_lock(&requests.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_lock");
+
+  slot = find_request(request);
+  if (slot != NULL && slot->requester == ACTOR_ID_NONE) {
+    slot->is_waited = true;
+    while (slot->state == REQUEST_PENDING && !is_system_dead())
+      if ((err = pthread_cond_wait(&requests.cond, &requests.lock)) != 0)
+        handle_error_en(err, "pthread_cond_wait");
+
+    is_replied = (slot->state == REQUEST_REPLIED);
+    if (is_replied)
+      *reply = slot->reply;
+    free_request_slot(request);
+  }
+
+  if ((err = pthread_mutex_unlock(&requests.lock)) != 0)
+    handle_error_en(err, "pthread_mutex_unlock");
+
+  return is_replied;
+}
+
+/* Writes an event to the current thread`s ring, overwriting the oldest
+ * one when it is full.
+ */
+void record_trace_event(enum trace_event_types type, actor_id_t actor, int64_t argument, uint64_t start) {
+#if CACTI_TRACE
+  trace_buffer *buffer = current_trace_buffer;
+  trace_event *event;
+  uint64_t now = get_time_ns(), position;
+
+  if (buffer != NULL) {
+    position = atomic_load_explicit(&buffer->number_of_events, memory_order_relaxed);
+    atomic_store_explicit(&buffer->number_of_events, position + 1, memory_order_relaxed);
+  } else {
+    buffer = &trace_buffers[pool_size];
+    position = atomic_fetch_add_explicit(&buffer->number_of_events, 1, memory_order_relaxed);
+  }
+
+  event = &buffer->events[position % TRACE_BUFFER_SIZE];
+  event->timestamp = (start != 0 ? start : now) - trace_start;
+  event->duration = (start != 0 ? now - start : 0);
+  event->actor = actor;
+  event->argument = argument;
+  event->type = type;
+#else
+  (void) type;
+  (void) actor;
+  (void) argument;
+  (void) start;
+#endif
+}
+
+#if CACTI_TRACE
+// Writes one event as Chrome trace-event JSON, thread is its tid.
+static void write_trace_event(FILE *file, const trace_event *event, uint32_t thread) {
+  double timestamp = event->timestamp / 1e3, duration = event->duration / 1e3;
+
+  switch (event->type) {
+    case TRACE_SEND:
+      fprintf(file, ",\n{\"name\": \"send\", \"cat\": \"message\", \"ph\": \"i\", \"s\": \"t\", "
+                    "\"ts\": %.3f, \"pid\": 1, \"tid\": %u, \"args\": {\"actor\": %ld, \"messages\": %ld}}",
+              timestamp, thread, event->actor, (long) event->argument);
+      break;
+    case TRACE_RUNNABLE:
+      // The flow ends when the actor starts receiving, showing how long he has waited.
+      fprintf(file, ",\n{\"name\": \"runnable\", \"cat\": \"queue\", \"ph\": \"i\", \"s\": \"t\", "
+                    "\"ts\": %.3f, \"pid\": 1, \"tid\": %u, \"args\": {\"actor\": %ld, \"thread\": %ld}}",
+              timestamp, thread, event->actor, (long) event->argument);
+      fprintf(file, ",\n{\"name\": \"queued\", \"cat\": \"queue\", \"ph\": \"s\", \"id\": %ld, "
+                    "\"ts\": %.3f, \"pid\": 1, \"tid\": %u}",
+              event->actor, timestamp, thread);
+      break;
+    case TRACE_RECEIVE:
+      fprintf(file, ",\n{\"name\": \"queued\", \"cat\": \"queue\", \"ph\": \"f\", \"bp\": \"e\", "
+                    "\"id\": %ld, \"ts\": %.3f, \"pid\": 1, \"tid\": %u}",
+              event->actor, timestamp, thread);
+      fprintf(file, ",\n{\"name\": \"receive\", \"cat\": \"actor\", \"ph\": \"X\", \"ts\": %.3f, "
+                    "\"dur\": %.3f, \"pid\": 1, \"tid\": %u, \"args\": {\"actor\": %ld, \"messages\": %ld}}",
+              timestamp, duration, thread, event->actor, (long) event->argument);
+      break;
+    case TRACE_SLEEP:
+      fprintf(file, ",\n{\"name\": \"sleep\", \"cat\": \"thread\", \"ph\": \"X\", \"ts\": %.3f, "
+                    "\"dur\": %.3f, \"pid\": 1, \"tid\": %u}",
+              timestamp, duration, thread);
+      break;
+    case TRACE_SPAWN:
+      fprintf(file, ",\n{\"name\": \"spawn\", \"cat\": \"actor\", \"ph\": \"i\", \"s\": \"t\", "
+                    "\"ts\": %.3f, \"pid\": 1, \"tid\": %u, \"args\": {\"actor\": %ld, \"parent\": %ld}}",
+              timestamp, thread, event->actor, (long) event->argument);
+      break;
+    case TRACE_GODIE:
+      fprintf(file, ",\n{\"name\": \"godie\", \"cat\": \"actor\", \"ph\": \"i\", \"s\": \"t\", "
+                    "\"ts\": %.3f, \"pid\": 1, \"tid\": %u, \"args\": {\"actor\": %ld}}",
+              timestamp, thread, event->actor);
+      break;
+  }
+}
+#endif
+
+/* Writes the rings of all threads to trace_path as Chrome trace-event JSON.
+ * Called after the threads have finished. A file that cannot be written
+ * is reported, but it does not stop the system from shutting down.
+ */
+void write_trace() {
+#if CACTI_TRACE
+  FILE *file;
+  uint64_t number_of_events, first;
+
+  if (trace_buffers == NULL)
+    return;
+
+  if ((file = fopen(trace_path, "w")) == NULL) {
+    perror(trace_path);
+    return;
+  }
+
+  fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+  fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"cacti\"}}");
+
+  for (uint32_t i = 0; i <= pool_size; i++) {
+    if (i < pool_size)
+      fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+                    "\"args\": {\"name\": \"worker %u\"}}", i, i);
+    else
+      fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+                    "\"args\": {\"name\": \"outside of the pool\"}}", i);
+
+    // Only the latest TRACE_BUFFER_SIZE events are left.
+    number_of_events = atomic_load(&trace_buffers[i].number_of_events);
+    first = (number_of_events > TRACE_BUFFER_SIZE ? number_of_events - TRACE_BUFFER_SIZE : 0);
+    for (uint64_t j = first; j < number_of_events; j++)
+      write_trace_event(file, &trace_buffers[i].events[j % TRACE_BUFFER_SIZE], i);
+  }
+
+  fprintf(file, "\n]}\n");
+
+  if (fclose(file) != 0)
+    perror(trace_path);
+#endif
 }
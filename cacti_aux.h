@@ -2,20 +2,78 @@
 #define CACTI_AUX_H
 
 #include "cacti.h"
+#include "global.h"
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
-extern void initialize();
+extern void initialize(const cacti_config_t *config);
+
+extern void initialize_actor(actor_id_t actor, actor_id_t parent, role_t *role);
 
 extern void clean_system_memory();
 
-extern void update_state_of_the_system(actor_id_t actor);
+extern bool update_state_of_the_system(actor_id_t actor, message_lane_t lane, uint32_t thread_number);
+
+extern void wake_up_all_threads(uint32_t thread_number);
+
+extern void adjust_size_of_actors_data(uint64_t n);
+
+extern void adjust_size_of_queue(actor_buffer *q, uint64_t n);
+
+extern message_node *allocate_message_node();
+
+extern void release_message_node(message_node *node);
+
+extern void release_message(message_node *node);
+
+extern void push_message_nodes(message_queue *queue, message_node *first, message_node *last);
+
+extern void push_message_node(message_queue *queue, message_node *node);
+
+extern long reserve_places_in_buffer(actor_id_t actor, size_t n, message_lane_t *lane, bool may_change_lane,
+                                     uint64_t *number_of_messages);
+
+extern void make_message_nodes(message_t *messages, size_t n, message_node **first, message_node **last);
+
+extern void write_messages_to_buffer(message_queue *queue, message_t *messages, size_t n);
+
+extern bool post_message_nodes(actor_id_t actor, message_lane_t lane, message_node *first, message_node *last,
+                               size_t n, uint64_t number_of_messages);
+
+extern void flush_outbox();
+
+extern message_node *pop_message_node(message_queue *queue, message_node **queue_head);
+
+extern message_node *obtain_message(actor_id_t actor, message_lane_t *lane);
+
+extern void *allocate_payload(size_t nbytes);
+
+extern void release_payload(void *data);
+
+extern void *allocate_shared_payload(size_t nbytes);
+
+extern void retain_shared_payload(void *data, uint64_t n);
+
+extern void release_shared_payload(void *data, uint64_t n);
+
+extern bool push_actors_to_queue(actor_id_t *actors, uint64_t n, uint32_t thread_number, uint64_t *number_of_actors);
+
+extern bool push_actor_to_queue(actor_id_t actor, uint32_t thread_number, uint64_t *number_of_actors);
+
+extern bool pop_actor_from_queue(actor_id_t *actor, uint32_t thread_number);
+
+extern bool steal_actor_from_other_queue(actor_id_t *actor, uint32_t thread_number);
 
-extern void adjust_size_of_actors_data();
+extern void wake_up_idle_thread(uint32_t thread_number);
 
-extern void adjust_size_of_queue(uint32_t thread_number);
+extern void add_actors_to_thread_queue(actor_id_t *actors, uint64_t n, uint32_t thread_number);
 
-extern void obtain_message(actor_id_t actor, message_t *message);
+extern actor_id_t *get_runnable_scratch(uint64_t n);
+
+extern void free_thread_scratch();
+
+extern void add_actors_to_thread_queues(actor_id_t *actors, uint64_t n);
 
 extern void add_actor_to_thread_queue(actor_id_t actor);
 
@@ -23,7 +81,21 @@ extern void *thread_task(void *data);
 
 extern bool is_system_dead();
 
-extern void create_new_actor(actor_id_t *new_actor, message_t message);
+extern void create_new_actor(actor_id_t *new_actor, actor_id_t parent, message_t message);
+
+extern uint64_t create_new_actors(actor_id_t *new_actors, uint64_t n, actor_id_t parent, role_t *role);
+
+extern router *create_router(router_strategy_t strategy, uint64_t n, role_t *role);
+
+extern void set_router_members(router *r, uint64_t n);
+
+extern void release_router(router *r);
+
+extern router *get_router(actor_id_t actor);
+
+extern actor_id_t route_message(actor_id_t actor, const uint64_t *key);
+
+extern void reclaim_actor(actor_id_t actor);
 
 extern void receive_hello(actor_id_t actor, message_t message);
 
@@ -33,8 +105,39 @@ extern void receive_godie(actor_id_t actor);
 
 extern void receive_standard_message(actor_id_t actor, message_t message);
 
-extern void actor_receive_message(actor_id_t actor_with_message);
+extern message_lane_t receive_one_message(actor_id_t actor_with_message);
+
+extern void actor_receive_message(actor_id_t actor_with_message, uint32_t thread_number);
+extern bool migrate_actor(actor_id_t actor);
+
+extern bool wait_for_new_actors(uint_fast64_t epoch);
+
+extern bool get_actor_to_receive_message(actor_id_t *actor_with_message, uint32_t thread_number);
+
+extern void push_blocking_actors(actor_id_t *actors, uint64_t n);
+
+extern void *blocking_thread_task(void *data);
+
+extern void join_blocking_threads();
+
+extern void *timer_task(void *data);
+
+extern timer_id_t add_timer(actor_id_t actor, message_t message, uint64_t delay_ns, uint64_t period_ns);
+
+extern bool remove_timer(timer_id_t timer);
+
+extern void join_timer_thread();
+
+extern cacti_request_t *open_request(actor_id_t requester, message_type_t reply_type, message_t message);
+
+extern void cancel_request(request_id_t request);
+
+extern bool complete_request(request_id_t request, size_t nbytes, void *data);
+
+extern bool wait_for_request(request_id_t request, message_t *reply);
+
+extern void record_trace_event(enum trace_event_types type, actor_id_t actor, int64_t argument, uint64_t start);
 
-extern void get_actor_to_receive_message(actor_id_t *actor_with_message, uint32_t thread_number);
+extern void write_trace();
 
 #endif // CACTI_AUX_H
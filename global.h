@@ -7,61 +7,597 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+// Size of a cache line, data written by different threads is kept on separate lines.
+#define CACHE_LINE_SIZE 64
+
+/* Counter written by all threads, alone on its cache line, so that its
+ * writes do not slow down reads of globals lying next to it.
+ */
+typedef struct padded_counter {
+  _Alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t value;
+} padded_counter;
 
 // Declaration of global variables.
 
-extern bool is_the_system_alive; // True when the system can shut down.
-extern uint64_t number_of_actors; // Number of actors in the system.
-extern uint64_t number_of_dead_and_finished_actors; // Actors that have empty queues and are dead.
+extern atomic_bool is_the_system_alive; // False when the system can shut down.
+extern atomic_uint_fast64_t number_of_actors; // Number of places in the actors table, indices below it are valid.
+extern padded_counter number_of_living_actors; // Actors that are not dead or still have messages.
+extern uint64_t *free_actors; // Indices of places in the actors table left by dead actors.
+extern uint64_t number_of_free_actors, free_actors_size; // Number of free places and length of the array.
 extern pthread_mutex_t mutex; // Mutex for access to make global data changes.
 extern pthread_attr_t attr; // pthread_attr_t for threads.
-extern pthread_t th[POOL_SIZE]; // Threads` ids.
-extern actor_id_t performing_actor[POOL_SIZE]; // Which actor is performing in a thread.
-extern pthread_cond_t cond[POOL_SIZE]; // Thread will go to sleep when it has nothing to do.
+extern uint32_t pool_size; // Number of threads.
+extern uint64_t actor_queue_limit; // Messages an actor can have waiting.
+extern uint64_t urgent_queue_limit; // Messages an actor can have waiting in the urgent lane.
+extern uint64_t cast_limit; // Maximal number of actors.
+extern bool is_outbox_enabled; // Handlers on the pool`s threads stage their messages, see cacti_config_t.buffer_sends.
+extern pthread_t *th; // Threads` ids.
+extern pthread_cond_t *cond; // Thread will go to sleep when it has nothing to do.
+extern padded_counter queue_epoch; // Incremented on every push, lets idle threads notice work to steal.
+extern _Thread_local actor_id_t performing_actor; // Which actor is performing in the current thread.
+extern _Thread_local uint32_t current_thread_number; // Number of the current thread, BLOCKING_THREAD_NUMBER outside of the pool.
+extern atomic_size_t throughput_quantum; // Messages received from one actor in a row.
+extern atomic_uint_fast64_t quantum_time_budget; // Nanoseconds spent on one actor in a row, 0 for no limit.
+extern atomic_size_t idle_spins; // Pauses of a thread without actors before yielding.
+extern atomic_size_t idle_yields; // Yields of a thread without actors before going to sleep.
+extern padded_counter number_of_spinning_threads; // Threads waiting for work without sleeping.
+
+// Counters kept by every thread, summed up by cacti_get_stats().
+enum stat_counters {
+  STAT_MESSAGES, // Messages received.
+  STAT_HANDLER_NS, // Time spent receiving messages.
+  STAT_IDLE_NS, // Time spent waiting on cond.
+  STAT_STEALS, // Actors stolen from other threads.
+  STAT_SENT, // Messages accepted by send functions.
+  STAT_QUEUE_FULL, // Messages rejected because of a full queue.
+  STAT_ACTOR_DEAD, // Messages rejected because of a dead actor.
+  STAT_SPAWNS, // Actors spawned.
+  NUMBER_OF_STAT_COUNTERS
+};
+
+#if CACTI_STATS
+/* Counters of one thread, on their own cache line. Only the owner writes
+ * them, except for the block shared by threads outside of the pool.
+ */
+typedef struct thread_stats {
+  _Alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t counters[NUMBER_OF_STAT_COUNTERS];
+} thread_stats;
+
+extern thread_stats *stats_of_threads; // Pool_size blocks and one for threads outside of the pool.
+extern _Thread_local thread_stats *current_thread_stats; // Block of the current thread, NULL outside of the pool.
+extern uint64_t finished_actors_high_water; // Mailbox high-water mark of actors already reclaimed.
+#endif
+
+// Kinds of traced events.
+enum trace_event_types {
+  TRACE_SEND, // Messages put into an actor`s buffer.
+  TRACE_RUNNABLE, // Actor put into a thread`s queue.
+  TRACE_RECEIVE, // Messages received from one actor in a row, a slice.
+  TRACE_SLEEP, // Thread asleep waiting for actors, a slice.
+  TRACE_SPAWN, // Actor spawned.
+  TRACE_GODIE // Actor received MSG_GODIE.
+};
+
+#if CACTI_TRACE
+// One traced event, a slice if duration is not 0.
+typedef struct trace_event {
+  uint64_t timestamp; // Nanoseconds since the system was created.
+  uint64_t duration; // Length of a slice in nanoseconds.
+  actor_id_t actor; // Actor the event is about.
+  int64_t argument; // Number of messages, parent`s id or home thread.
+  enum trace_event_types type;
+} trace_event;
+
+/* Ring of the latest TRACE_BUFFER_SIZE events of one thread. Only the
+ * owner writes it, except for the ring shared by threads outside of the
+ * pool, which writers enter with fetch_add. Rings are read after all
+ * threads have finished.
+ */
+typedef struct trace_buffer {
+  _Alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t number_of_events; // Events ever written.
+  trace_event *events;
+} trace_buffer;
+
+extern trace_buffer *trace_buffers; // Pool_size rings and one for threads outside of the pool, NULL if not tracing.
+extern _Thread_local trace_buffer *current_trace_buffer; // Ring of the current thread, NULL outside of the pool.
+extern uint64_t trace_start; // Time of creating the system.
+extern char *trace_path; // File the trace is written to.
+#endif
+
+// Where data of a message lives.
+enum payload_kinds {
+  PAYLOAD_POINTER, // Owned by the sender, as given to send_message.
+  PAYLOAD_INLINE, // In the node`s inline_data.
+  PAYLOAD_OWNED, // In a block from allocate_payload, released after the handler.
+  PAYLOAD_SHARED // In a block from allocate_shared_payload, its reference is dropped after the handler.
+};
+
+// One message in a message_buffer, taken from a pool of nodes.
+typedef struct message_node {
+  _Atomic(struct message_node *) next; // Next node in the buffer or in the pool.
+  message_t message; // The actual data.
+  enum payload_kinds payload; // Where message.data points.
+  _Alignas(8) unsigned char inline_data[MESSAGE_INLINE_SIZE]; // Copied payload of PAYLOAD_INLINE.
+} message_node;
+
+/* Stub of a message_queue. It is only ever used through its next, the first
+ * member of a node, so it is kept without the rest of a node.
+ */
+typedef struct message_stub {
+  _Atomic(message_node *) next;
+} message_stub;
+
+/* Header of a payload block. Blocks of one size class are carved out of
+ * chunks of a thread`s payload_cache and always come back to it.
+ */
+typedef struct payload_header {
+  struct payload_cache *owner; // Cache of the block, NULL for blocks from malloc.
+  union {
+    struct payload_header *next; // Next free block of the class.
+    uint64_t size_class; // Size class of a block in use.
+  };
+} payload_header;
+
+/* Header of a shared payload, between the payload block`s header and the
+ * data. The data is freed when the last reference is dropped.
+ */
+typedef struct shared_header {
+  _Alignas(16) atomic_uint_fast64_t references; // The owner`s one and one for every message queued.
+} shared_header;
+
+// Number of payload size classes, blocks of class i have PAYLOAD_MIN_BLOCK << i bytes.
+#define NUMBER_OF_PAYLOAD_CLASSES 7
+
+/* Free payload blocks of one thread. Only the owner takes blocks and frees
+ * to free_blocks, other threads free to remote_blocks, which the owner takes
+ * all at once when its own list runs out.
+ */
+typedef struct payload_cache {
+  payload_header *free_blocks[NUMBER_OF_PAYLOAD_CLASSES]; // Used only by the owner.
+  _Atomic(payload_header *) remote_blocks[NUMBER_OF_PAYLOAD_CLASSES]; // Freed by other threads.
+  void **chunks; // Allocated chunks, freed with the system.
+  uint64_t number_of_chunks, chunks_size; // Number of chunks and length of the array.
+  struct payload_cache *next; // Next cache of the system.
+} payload_cache;
+
+extern payload_cache *payload_caches; // Caches of all threads that have allocated payloads.
+
+// Number of lanes of an actor`s buffer, see message_lane_t.
+#define NUMBER_OF_LANES 2
+
+/* List of messages acting as a lock-free queue with many writers and
+ * a single reader, the thread which is processing the actor. An empty
+ * queue holds only its stub, so an idle actor owns no nodes. The reader`s
+ * head is kept apart, away from the writers` cache line.
+ */
+typedef struct message_queue {
+  _Atomic(message_node *) tail; // Last written node, swapped by writers.
+  message_stub stub; // Keeps the list non-empty when there are no messages.
+} message_queue;
+
+// Returns the queue`s stub as a node, only its next may be used.
+static inline message_node *get_stub(message_queue *queue) {
+  return (message_node *) &queue->stub;
+}
 
-// Cyclic buffer of messages acting as a queue.
+// Messages of an actor, one queue for every lane, as seen by writers.
 typedef struct message_buffer {
-  message_t *messages; // The actual data.
-  uint64_t readpos, writepos; // Positions for reading and writing.
-  uint64_t number_of_messages; // Number of messages in the buffer.
+  message_queue lanes[NUMBER_OF_LANES];
+  /* Number of messages in every lane, waiting or being received (bits
+   * given by LANE_SHIFT and LANE_MASK), ACTOR_DEAD_FLAG set once the actor
+   * has received MSG_GODIE and the generation of the actor using the place
+   * (from GENERATION_SHIFT up). The writer that changes the number in both
+   * lanes from 0 to 1 makes the actor runnable, the reader that changes it
+   * to 0 makes it idle.
+   */
+  atomic_uint_fast64_t number_of_messages;
 } message_buffer;
 
-// Basic info about an actor.
+/* Nodes sent by a handler to one lane of an actor, linked in order, which
+ * wait in the outbox of the thread until the handler returns.
+ */
+typedef struct staged_messages {
+  actor_id_t actor; // Receiver.
+  message_lane_t lane; // Lane asked for, places are reserved when the outbox is flushed.
+  uint64_t number_of_messages; // Number of linked nodes.
+  uint64_t order; // Position in the outbox, keeps messages in order when sorted.
+  message_node *first, *last; // Linked nodes.
+} staged_messages;
+
+// Most staged messages sorted by insertion when the outbox is flushed, more are sorted by qsort.
+#define OUTBOX_INSERTION_SORT_LIMIT 16
+
+// Number of points of every member on the ring of a consistent-hash router.
+#define ROUTER_RING_POINTS 64
+
+// Point of a member on the ring of a consistent-hash router.
+typedef struct router_point {
+  uint64_t hash; // Position on the ring.
+  uint64_t member; // Index of the member in router.members.
+} router_point;
+
+/* A router takes a place of the actors table which never holds an actor,
+ * so its id is checked like actors` ids. Once it is set up only next and,
+ * with access to global data, number_of_living_members change. The place
+ * is freed when the last member dies. Senders hold a reference while they
+ * route, the last one frees the arrays and the struct waits for a new
+ * router, it is freed only with the system.
+ */
+typedef struct router {
+  actor_id_t id; // Id of the router`s place.
+  router_strategy_t strategy;
+  actor_id_t *members; // Ids of members, spawned together.
+  uint64_t number_of_members;
+  uint64_t number_of_living_members; // Members not reclaimed yet.
+  atomic_uint_fast64_t next; // Member getting the next message in turn.
+  router_point *ring; // Points of members sorted by hash, for ROUTER_CONSISTENT_HASH.
+  atomic_uint_fast64_t references; // Senders routing now, and one while the place is not freed.
+  struct router *next_router; // Next router of the system, routers are freed with it.
+  struct router *next_free_router; // Next router waiting for reuse.
+} router;
+
+extern router *routers; // All routers of the system, dead ones included.
+
+// Routers without references, waiting for reuse.
+extern struct free_router_list {
+  pthread_mutex_t lock;
+  router *first;
+} free_routers;
+
+/* Basic info about an actor, two cache lines long. The first one is used
+ * by senders, the second one by the thread processing the actor, so
+ * neither side nor neighbouring actors disturb each other`s lines.
+ */
 typedef struct actor_info {
-  actor_id_t id; // Actor`s id.
-  role_t *role; // Actor`s role.
+  _Alignas(CACHE_LINE_SIZE) message_buffer msg_q; // Buffer of messages acting as a queue.
+  /* Thread that has made the actor runnable most often lately and its
+   * majority votes. Written by many threads without care, it is a sample.
+   */
+  atomic_uint_least32_t affinity_thread;
+  atomic_uint_least32_t affinity_votes;
+  atomic_uint_least32_t home_thread; // Thread whose queue the actor goes to when he becomes runnable.
+  bool is_blocking; // Role of the actor has ROLE_BLOCKING, he runs on the blocking pool.
+  _Atomic(router *) router; // Router holding the place, or the router of a member, NULL for other actors.
+
+  _Alignas(CACHE_LINE_SIZE) message_node *heads[NUMBER_OF_LANES]; // Next node to read in every lane.
   void *state; // Actor`s state.
-  message_buffer msg_q; // Buffer of messages acting as a queue.
-  pthread_mutex_t lock;  // Mutex ensuring exclusive access to buffer.
-  bool is_actor_dead; // True if actor has received MSG_GODIE.
+  role_t *role; // Actor`s role.
+  actor_id_t id; // Actor`s id.
+  actor_id_t parent; // Id of the actor that has spawned him, sent with MSG_HELLO.
+#if CACTI_STATS
+  atomic_uint_fast64_t messages_received; // Written only by the thread processing the actor.
+  atomic_uint_fast64_t queue_high_water; // Most messages in the buffer at once, written like messages_received.
+#endif
 } actor_info;
 
-extern actor_info *actors; // An array of actors` info.
-extern uint64_t actor_info_length; // Length of an actors array.
+// Number of levels of the timing wheel and of slots in one level.
+#define TIMER_LEVELS 4
+#define TIMER_SLOTS 64
+
+// A timer, kept in a slot of the wheel while pending and in the free list otherwise.
+typedef struct timer_entry {
+  actor_id_t actor; // Receiver of the message.
+  message_t message; // Message sent when the timer expires.
+  uint64_t expires; // Tick at which the timer expires.
+  uint64_t period; // Ticks between expirations of a periodic timer, 0 for a one-shot timer.
+  uint64_t generation; // Changes every time the entry is freed, a part of the timer`s id.
+  int64_t prev, next; // Neighbours in the slot or the next free entry, -1 for none.
+  int32_t slot; // Slot of the wheel the entry is in, -1 if it is free.
+} timer_entry;
+
+// Expired timer waiting for its message to be delivered.
+typedef struct fired_timer {
+  timer_id_t id; // Id of the timer, cancelled if the actor turns out to be dead.
+  actor_id_t actor; // Receiver of the message.
+  message_t message; // Message to deliver.
+} fired_timer;
+
+/* Hierarchical timing wheel of all timers. Level i has TIMER_SLOTS slots
+ * of TIMER_SLOTS^i ticks each. A timer goes to the lowest level whose slot
+ * is not yet reached and moves down when it is. Entries are linked by
+ * their indices, so the array can grow without fixing the lists.
+ */
+typedef struct timer_wheel {
+  pthread_mutex_t lock; // Mutex ensuring exclusive access to the wheel.
+  pthread_cond_t cond; // The timer thread waits on it for the next tick or an earlier timer.
+  pthread_t thread; // Thread delivering expired timers, started with the first timer.
+  bool is_thread_running; // True once the thread has been started.
+  uint64_t start_ns, tick_ns; // Time of tick 0 and length of a tick.
+  uint64_t current; // Next tick to process, earlier ones are done.
+  uint64_t wake_tick; // Tick the timer thread sleeps until, UINT64_MAX if it waits for timers.
+  int64_t slots[TIMER_LEVELS * TIMER_SLOTS]; // First entries of slots, -1 for empty ones.
+  timer_entry *entries; // All entries, pending and free.
+  uint64_t number_of_entries, entries_size; // Number of used entries and length of the array.
+  int64_t free_entries; // First free entry, -1 for none.
+  uint64_t number_of_pending; // Timers in the wheel.
+  fired_timer *fired; // Expired timers to deliver, used only by the timer thread.
+  actor_id_t *runnable; // Actors made runnable by delivery, as long as fired.
+  uint64_t number_of_fired, fired_size; // Number of expired timers and length of the arrays.
+} timer_wheel;
+
+extern timer_wheel timers;
+
+// States of a request slot.
+enum request_states {
+  REQUEST_FREE, // In the free list.
+  REQUEST_PENDING, // Sent, not yet replied.
+  REQUEST_REPLIED // Replied, the reply waits for wait_for_reply.
+};
 
-// Buffer of actor_id_t acting as a queue.
+// A request waiting for its reply, kept in place until then.
+typedef struct request_slot {
+  cacti_request_t request; // Given to the handler of the request.
+  actor_id_t requester; // Actor the reply is sent to, ACTOR_ID_NONE if it is waited for.
+  message_type_t reply_type; // Type of the reply sent to the requester.
+  message_t reply; // The reply, once replied.
+  enum request_states state; // State of the slot.
+  bool is_waited; // Some thread waits for the reply on requests.cond.
+  uint64_t generation; // Changes every time the slot is freed, a part of request_id_t.
+  int64_t next_free; // Next free slot, -1 for none.
+} request_slot;
+
+/* Slots of requests, kept in chunks of REQUESTS_CHUNK_SIZE slots, so
+ * handlers can keep pointers to them. Freed slots are reused, so requests
+ * allocate nothing once enough chunks are there.
+ */
+typedef struct request_table {
+  pthread_mutex_t lock; // Mutex ensuring exclusive access to the table.
+  pthread_cond_t cond; // Threads in wait_for_reply wait on it.
+  request_slot **chunks; // Allocated chunks of slots.
+  uint64_t number_of_chunks, chunks_size; // Number of chunks and length of the array.
+  uint64_t number_of_slots; // Slots ever used, the rest of the last chunk is untouched.
+  int64_t free_slots; // First free slot, -1 for none.
+} request_table;
+
+extern request_table requests;
+
+/* Actors` info, kept in segments of ACTORS_SEGMENT_SIZE actors each.
+ * A segment is never moved or freed while the system is alive, so
+ * pointers to actor_info stay valid.
+ */
+extern actor_info **actors;
+
+/* Spare message nodes shared by all threads. Threads keep their own lists
+ * of free nodes and exchange them with the depot in batches.
+ */
+typedef struct node_depot {
+  pthread_mutex_t lock; // Mutex ensuring exclusive access to the depot.
+  message_node **batches; // Spare batches, each a list of MESSAGE_NODES_BATCH_SIZE nodes.
+  uint64_t number_of_batches, batches_size; // Number of spare batches and length of the array.
+  message_node **chunks; // Allocated arrays of nodes, freed with the system.
+  uint64_t number_of_chunks, chunks_size; // Number of chunks and length of the array.
+  uint64_t generation; // Changes with every actor system, so threads drop stale nodes.
+} node_depot;
+
+extern node_depot message_nodes;
+
+/* Buffer of actor_id_t acting as a double-ended queue. The owning thread
+ * takes actors from the front, idle threads steal them from the back.
+ * Buffers of threads lie next to each other, each on its own cache lines.
+ */
 typedef struct actor_buffer {
-  actor_id_t *actor_id; // Actor`s id.
+  _Alignas(CACHE_LINE_SIZE) actor_id_t *actor_id; // Actor`s id.
   pthread_mutex_t lock;  // Mutex ensuring exclusive access to buffer.
   actor_id_t readpos, writepos; // Positions for reading and writing.
   uint64_t size; // Size of the buffer.
   uint64_t number_of_actors; // Number of actors in the buffer.
+  atomic_bool is_sleeping; // True when the owning thread of the pool waits on its cond, set under lock.
+#if CACTI_STATS
+  uint64_t high_water; // Most actors in the buffer at once.
+#endif
 } actor_buffer;
 
 /* Actor_buffer, one for every thread acting as a queue.
  * If actor is in the buffer it means he has a message to receive.
+ * An actor is in at most one buffer at a time and never while being processed.
  */
 extern actor_buffer *actor_q;
 
+/* Threads for actors with ROLE_BLOCKING, sharing one queue of actors, so
+ * a handler blocked in a syscall never holds up a thread of the pool. A
+ * thread is started when such an actor becomes runnable and no thread is
+ * idle, up to the limit. A thread idle for BLOCKING_IDLE_TIMEOUT_US ends,
+ * unless only BLOCKING_POOL_MIN are left, and is joined by the next push
+ * or when the system is joined.
+ */
+typedef struct blocking_pool {
+  actor_buffer queue; // Runnable blocking actors, its lock guards the whole pool.
+  pthread_cond_t cond; // Idle threads wait on it.
+  pthread_attr_t attr; // Attributes of the threads and the timer thread, with the stack size and CPUs of the config.
+  pthread_t *threads; // Started threads.
+  uint64_t number_of_threads, threads_size; // Number of started threads and length of the array.
+  pthread_t *retired; // Threads that have ended for being idle, not joined yet.
+  uint64_t number_of_retired, retired_size; // Number of such threads and length of the array.
+  uint64_t number_of_idle_threads; // Threads waiting on cond.
+  uint64_t limit; // Most threads.
+} blocking_pool;
+
+extern blocking_pool blocking_threads;
+
 
 // Constants
 
+// Number of request slots allocated at once.
+static const uint64_t REQUESTS_CHUNK_SIZE = 256;
+
+// Thread number of threads of the blocking pool and outside threads, never a number of a thread of the pool.
+static const uint32_t BLOCKING_THREAD_NUMBER = UINT32_MAX;
+
 // Multiplier for reallocs in implementation of a vector.
 static const uint64_t MULTIPLIER = 3;
 
 // Divider for reallocs in implementation of a vector.
 static const uint64_t DIVIDER = 2;
 
+/* Actor_id_t consists of the index of the actor`s place in the actors table
+ * (lower ACTOR_INDEX_BITS bits) and the generation of the place, which
+ * changes every time the place is taken by a new actor.
+ */
+static const int ACTOR_INDEX_BITS = 32;
+
+// Bits of message_buffer.number_of_messages holding the numbers of messages in all lanes.
+static const uint64_t MESSAGES_MASK = ((uint64_t) 1 << 32) - 1;
+
+// Positions of the numbers of messages of the lanes in message_buffer.number_of_messages.
+static const int LANE_SHIFT[NUMBER_OF_LANES] = {0, 24};
+
+// Masks of the numbers of messages of the lanes, applied after shifting.
+static const uint64_t LANE_MASK[NUMBER_OF_LANES] = {((uint64_t) 1 << 24) - 1, ((uint64_t) 1 << 8) - 1};
+
+// Bit of message_buffer.number_of_messages telling that the actor is dead.
+static const uint64_t ACTOR_DEAD_FLAG = (uint64_t) 1 << 32;
+
+// Position of the generation in message_buffer.number_of_messages.
+static const int GENERATION_SHIFT = 33;
+
+/* Timer_id_t consists of the index of the timer`s entry (lower
+ * ACTOR_INDEX_BITS bits, as in actor_id_t) and its generation.
+ */
+static const int TIMER_GENERATION_BITS = 31;
+
+// Bits of a slot`s index in a level of the timing wheel.
+static const int TIMER_SLOT_BITS = 6;
+
+// Number of message nodes allocated at once and exchanged with the depot.
+static const uint64_t MESSAGE_NODES_BATCH_SIZE = 64;
+
+// Size of the smallest payload block, with its header.
+static const uint64_t PAYLOAD_MIN_BLOCK = 64;
+
+// Size of a chunk a thread carves payload blocks of one class from.
+static const uint64_t PAYLOAD_CHUNK_SIZE = 65536;
+
+// Number of actors in one segment of the actors table.
+static const uint64_t ACTORS_SEGMENT_SIZE = 1024;
+
+
+// Functions
+
+// Returns current time of a monotonic clock in nanoseconds.
+static inline uint64_t get_time_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Tells the CPU that the thread is busy waiting.
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+// Returns current time for statistics, 0 if they are compiled out.
+static inline uint64_t get_stats_time_ns() {
+#if CACTI_STATS
+  return get_time_ns();
+#else
+  return 0;
+#endif
+}
+
+// Adds n to a counter of the current thread.
+static inline void add_to_stat(enum stat_counters counter, uint64_t n) {
+#if CACTI_STATS
+  if (current_thread_stats != NULL) {
+    // Nobody else writes it, so there is no need for an atomic addition.
+    atomic_uint_fast64_t *value = &current_thread_stats->counters[counter];
+    atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+  } else {
+    atomic_fetch_add_explicit(&stats_of_threads[pool_size].counters[counter], n, memory_order_relaxed);
+  }
+#else
+  (void) counter;
+  (void) n;
+#endif
+}
+
+// Tells whether events are traced.
+static inline bool is_tracing() {
+#if CACTI_TRACE
+  return trace_buffers != NULL;
+#else
+  return false;
+#endif
+}
+
+// Returns current time for slices of a trace, 0 if not tracing.
+static inline uint64_t get_trace_time_ns() {
+  return (is_tracing() ? get_time_ns() : 0);
+}
+
+// Returns index of the actor`s place in the actors table.
+static inline uint64_t get_actor_index(actor_id_t actor) {
+  return (uint64_t) actor & (((uint64_t) 1 << ACTOR_INDEX_BITS) - 1);
+}
+
+// Returns generation of the actor`s place in the actors table.
+static inline uint64_t get_actor_generation(actor_id_t actor) {
+  return (uint64_t) actor >> ACTOR_INDEX_BITS;
+}
+
+// Places are published in order of their indices, so one load validates the index.
+static inline bool is_actor_id_valid(actor_id_t actor) {
+  return actor >= 0 && get_actor_index(actor) < atomic_load(&number_of_actors);
+}
+
+/* Returns info of an actor with a valid id. It might be a newer actor in
+ * the same place, the generation is checked when reserving places.
+ */
+static inline actor_info *get_actor(actor_id_t actor) {
+  uint64_t index = get_actor_index(actor);
+
+  return &actors[index / ACTORS_SEGMENT_SIZE][index % ACTORS_SEGMENT_SIZE];
+}
+
+// Returns the number of messages in a lane out of message_buffer.number_of_messages.
+static inline uint64_t get_lane_messages(uint64_t number_of_messages, message_lane_t lane) {
+  return number_of_messages >> LANE_SHIFT[lane] & LANE_MASK[lane];
+}
+
+// Returns the lane of a message sent without one, MSG_SPAWN and MSG_GODIE go to the urgent lane.
+static inline message_lane_t get_message_lane(message_type_t message_type) {
+  return (message_type == MSG_SPAWN || message_type == MSG_GODIE ? LANE_URGENT : LANE_NORMAL);
+}
+
+// Returns the number of messages in all lanes out of message_buffer.number_of_messages.
+static inline uint64_t count_messages(uint64_t number_of_messages) {
+  return get_lane_messages(number_of_messages, LANE_NORMAL) + get_lane_messages(number_of_messages, LANE_URGENT);
+}
+
+// Returns the thread, whose queue the actor goes to when he becomes runnable.
+static inline uint32_t get_home_thread(actor_id_t actor) {
+  return atomic_load_explicit(&get_actor(actor)->home_thread, memory_order_relaxed);
+}
+
+/* Counts the current thread`s vote for taking the actor, who is made
+ * runnable by it. Boyer-Moore majority vote, so one thread sending most
+ * of the actor`s messages soon wins.
+ */
+static inline void sample_sender_thread(actor_id_t actor) {
+  actor_info *info = get_actor(actor);
+  uint_fast32_t votes = atomic_load_explicit(&info->affinity_votes, memory_order_relaxed);
+
+  if (current_thread_number >= pool_size || MIGRATION_VOTES == 0)
+    return;
+
+  if (atomic_load_explicit(&info->affinity_thread, memory_order_relaxed) == current_thread_number) {
+    atomic_store_explicit(&info->affinity_votes, votes + 1, memory_order_relaxed);
+  } else if (votes == 0) {
+    atomic_store_explicit(&info->affinity_thread, current_thread_number, memory_order_relaxed);
+    atomic_store_explicit(&info->affinity_votes, 1, memory_order_relaxed);
+  } else {
+    atomic_store_explicit(&info->affinity_votes, votes - 1, memory_order_relaxed);
+  }
+}
+
 
 // Macros
 
@@ -72,6 +608,12 @@ static const uint64_t DIVIDER = 2;
 #define handle_error(msg) \
                do { perror(msg); exit(EXIT_FAILURE); } while (0)
 
+/* Records an event if tracing. Start is the beginning of a slice, taken
+ * with get_trace_time_ns(), or 0 for an instant event.
+ */
+#define trace_event_if_tracing(type, actor, argument, start) \
+              do { if (is_tracing()) record_trace_event(type, actor, argument, start); } while (0)
+
 
 // Checks whether an alloc returned NULL.
 static inline void check_alloc_validity(void *const data) {
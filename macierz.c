@@ -3,14 +3,18 @@
 
 typedef void (*act)(void **stateptr, size_t nbytes, void *data);
 
+// Actors spawned so far, they are born one after another.
+static int spawned = 1;
+
 void f(void **stateptr, size_t nbytes, void *data) {
   printf("HELLO WORLD\n");
   static act prompts[1];
   prompts[0] = &f;
-  static role_t a = {1, prompts};
+  static role_t a = {1, prompts, 0};
   a.nprompts = 0;
 
-  if (actor_id_self() < 4) {
+  if (spawned < 5) {
+    spawned++;
     message_t message = {MSG_SPAWN, sizeof(role_t), &a};
     send_message(actor_id_self(), message);
   }
@@ -23,7 +27,7 @@ int main() {
   actor_id_t first;
   act prompts[1];
   prompts[0] = &f;
-  role_t a = {1, prompts};
+  role_t a = {1, prompts, 0};
   a.nprompts = 0;
   actor_system_create(&first, &a);
   message_t message = {MSG_GODIE, 0, NULL};
@@ -0,0 +1,122 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// Threads started for blocking actors end after being idle, down to BLOCKING_POOL_MIN.
+
+#define BLOCKING_ACTORS 4
+#define SLEEP_US 50000
+
+#define MSG_DONE (message_type_t)0x1
+#define MSG_CHECK (message_type_t)0x2
+
+int tests_run = 0;
+
+static long done, threads_busy = -1, threads_idle = -1;
+
+// Returns the number of threads of the process.
+static long count_threads()
+{
+	DIR *dir = opendir("/proc/self/task");
+	long count = 0;
+
+	if (dir == NULL)
+		return -1;
+	while (readdir(dir) != NULL)
+		count++;
+	closedir(dir);
+
+	// Without "." and "..".
+	return count - 2;
+}
+
+static void sleeper_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	message_t done_message = {MSG_DONE, 0, NULL};
+	message_t godie = {MSG_GODIE, 0, NULL};
+
+	usleep(SLEEP_US);
+	send_message(*(actor_id_t *) data, done_message);
+	send_message(actor_id_self(), godie);
+}
+
+static act_t sleeper_prompts[] = {sleeper_hello};
+static role_t sleeper_role = {1, sleeper_prompts, ROLE_BLOCKING};
+
+static void parent_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	actor_id_t sleepers[BLOCKING_ACTORS];
+
+	spawn_actors(&sleeper_role, BLOCKING_ACTORS, sleepers);
+}
+
+// Counts threads when all sleepers are done and again when the idle ones should have ended.
+static void parent_done(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	message_t check = {MSG_CHECK, 0, NULL};
+
+	if (++done < BLOCKING_ACTORS)
+		return;
+
+	send_message_after(actor_id_self(), check, 2 * BLOCKING_IDLE_TIMEOUT_US);
+	threads_busy = count_threads();
+}
+
+static void parent_check(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	message_t godie = {MSG_GODIE, 0, NULL};
+
+	threads_idle = count_threads();
+	send_message(actor_id_self(), godie);
+}
+
+static act_t parent_prompts[] = {parent_hello, parent_done, parent_check};
+static role_t parent_role = {3, parent_prompts, 0};
+
+static char *idle_threads_end()
+{
+	actor_id_t actor;
+
+	mu_assert("system not created", actor_system_create(&actor, &parent_role) == 0);
+	actor_system_join(actor);
+
+	mu_assert("threads not counted", threads_busy > 0 && threads_idle > 0);
+	mu_assert("idle threads not ended", threads_busy - threads_idle >= BLOCKING_ACTORS - BLOCKING_POOL_MIN);
+	return 0;
+}
+
+static char *all_tests()
+{
+	mu_run_test(idle_threads_end);
+	return 0;
+}
+
+int main()
+{
+	char *result = all_tests();
+	if (result != 0)
+	{
+		printf(__FILE__ ": %s\n", result);
+	}
+	else
+	{
+		printf(__FILE__ ": ALL TESTS PASSED\n");
+	}
+	printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+	return result != 0;
+}
@@ -0,0 +1,214 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/* Send_message keeps the order of one sender, the urgent lane is taken
+ * only when asked for and by MSG_SPAWN and MSG_GODIE.
+ */
+
+#define MESSAGES 100
+#define LIMIT 4
+
+#define MSG_WORK (message_type_t)0x1
+#define MSG_NEXT (message_type_t)0x2
+#define MSG_NUMBER (message_type_t)0x3
+#define MSG_URGENT (message_type_t)0x4
+
+int tests_run = 0;
+
+static int continuation_result, continuations, numbers, out_of_order, received_before_urgent;
+static int number_result, godie_result, second_godie_result;
+static bool is_urgent_received;
+
+static void hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+}
+
+// Sends the rest of the work to himself, MSG_GODIE is still behind it.
+static void work(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	message_t next = {MSG_NEXT, 0, NULL};
+
+	continuation_result = send_message(actor_id_self(), next);
+}
+
+static void next(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+
+	continuations++;
+}
+
+static void number(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) data;
+
+	if (is_urgent_received)
+		return;
+	if ((int) nbytes != numbers++)
+		out_of_order++;
+	received_before_urgent++;
+}
+
+static void urgent(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+
+	is_urgent_received = true;
+}
+
+static act_t prompts[] = {hello, work, next, number, urgent};
+static role_t role = {5, prompts, 0};
+
+static char *godie_after_earlier_messages()
+{
+	actor_id_t actor;
+	message_t work_message = {MSG_WORK, 0, NULL};
+	message_t godie = {MSG_GODIE, 0, NULL};
+
+	continuation_result = -2;
+	continuations = 0;
+
+	mu_assert("system not created", actor_system_create(&actor, &role) == 0);
+	mu_assert("work not sent", send_message(actor, work_message) == 0);
+	mu_assert("godie not sent", send_message(actor, godie) == 0);
+	actor_system_join(actor);
+
+	mu_assert("continuation rejected", continuation_result == 0);
+	mu_assert("continuation not received", continuations == 1);
+	return 0;
+}
+
+static char *messages_in_order()
+{
+	actor_id_t actor;
+	message_t godie = {MSG_GODIE, 0, NULL};
+
+	numbers = out_of_order = received_before_urgent = 0;
+	is_urgent_received = false;
+
+	mu_assert("system not created", actor_system_create(&actor, &role) == 0);
+	for (int i = 0; i < MESSAGES; i++) {
+		message_t message = {MSG_NUMBER, (size_t) i, NULL};
+		mu_assert("number not sent", send_message(actor, message) == 0);
+	}
+	mu_assert("godie not sent", send_message(actor, godie) == 0);
+	actor_system_join(actor);
+
+	mu_assert("messages out of order", out_of_order == 0);
+	mu_assert("messages lost", numbers == MESSAGES);
+	return 0;
+}
+
+// Sends numbers and an urgent message to himself while he is busy, so they all wait.
+static void urgent_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	message_t urgent_message = {MSG_URGENT, 0, NULL};
+	message_t godie = {MSG_GODIE, 0, NULL};
+
+	for (int i = 0; i < MESSAGES; i++) {
+		message_t message = {MSG_NUMBER, (size_t) i, NULL};
+		send_message(actor_id_self(), message);
+	}
+	send_message_to_lane(actor_id_self(), urgent_message, LANE_URGENT);
+	send_message(actor_id_self(), godie);
+}
+
+static act_t urgent_prompts[] = {urgent_hello, work, next, number, urgent};
+static role_t urgent_role = {5, urgent_prompts, 0};
+
+static char *urgent_lane_first()
+{
+	actor_id_t actor;
+
+	numbers = out_of_order = received_before_urgent = 0;
+	is_urgent_received = false;
+
+	mu_assert("system not created", actor_system_create(&actor, &urgent_role) == 0);
+	actor_system_join(actor);
+
+	mu_assert("urgent message not received", is_urgent_received);
+	mu_assert("urgent message behind normal ones", received_before_urgent == 0);
+	return 0;
+}
+
+// Fills the normal lane of himself, MSG_GODIE has places of its own.
+static void full_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	message_t godie = {MSG_GODIE, 0, NULL};
+
+	for (int i = 0; i <= LIMIT; i++) {
+		message_t message = {MSG_NUMBER, (size_t) i, NULL};
+		number_result = send_message(actor_id_self(), message);
+	}
+	godie_result = send_message(actor_id_self(), godie);
+	second_godie_result = send_message(actor_id_self(), godie);
+}
+
+static act_t full_prompts[] = {full_hello, work, next, number, urgent};
+static role_t full_role = {5, full_prompts, 0};
+
+static char *godie_with_full_normal_lane()
+{
+	// One MSG_GODIE fills the urgent lane.
+	cacti_config_t config = {.actor_queue_limit = LIMIT, .urgent_queue_limit = 1};
+	actor_id_t actor;
+
+	numbers = out_of_order = received_before_urgent = 0;
+	is_urgent_received = false;
+
+	mu_assert("system not created", actor_system_create_ex(&actor, &full_role, &config) == 0);
+	actor_system_join(actor);
+
+	mu_assert("number beyond the limit accepted", number_result == -3);
+	mu_assert("godie rejected by the normal lane", godie_result == 0);
+	mu_assert("godie accepted by a full urgent lane", second_godie_result == -3);
+	// MSG_HELLO being received takes one place of the normal lane.
+	mu_assert("messages before godie lost", numbers == LIMIT - 1);
+	mu_assert("messages out of order", out_of_order == 0);
+	return 0;
+}
+
+static char *all_tests()
+{
+	mu_run_test(godie_after_earlier_messages);
+	mu_run_test(messages_in_order);
+	mu_run_test(urgent_lane_first);
+	mu_run_test(godie_with_full_normal_lane);
+	return 0;
+}
+
+int main()
+{
+	char *result = all_tests();
+	if (result != 0)
+	{
+		printf(__FILE__ ": %s\n", result);
+	}
+	else
+	{
+		printf(__FILE__ ": ALL TESTS PASSED\n");
+	}
+	printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+	return result != 0;
+}
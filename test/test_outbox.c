@@ -0,0 +1,217 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/* Messages staged with buffer_sends keep their order, go out before
+ * a handler waits for a reply and hold back no receiver before that.
+ */
+
+#define MESSAGES 1000
+
+#define MSG_NUMBER (message_type_t)0x1
+#define MSG_REQUEST (message_type_t)0x1
+#define MSG_FLAG (message_type_t)0x1
+
+int tests_run = 0;
+
+static int numbers, out_of_order, wait_result = -2;
+static size_t replied_nbytes;
+
+static void receiver_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+}
+
+static void receiver_number(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) data;
+
+	if ((int) nbytes != numbers++)
+		out_of_order++;
+}
+
+static act_t receiver_prompts[] = {receiver_hello, receiver_number};
+static role_t receiver_role = {2, receiver_prompts, 0};
+
+static void sender_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	actor_id_t receiver;
+	message_t godie = {MSG_GODIE, 0, NULL};
+
+	spawn_actors(&receiver_role, 1, &receiver);
+	for (int i = 0; i < MESSAGES; i++) {
+		message_t message = {MSG_NUMBER, (size_t) i, NULL};
+		send_message(receiver, message);
+	}
+	send_message(receiver, godie);
+	send_message(actor_id_self(), godie);
+}
+
+static act_t sender_prompts[] = {sender_hello};
+static role_t sender_role = {1, sender_prompts, 0};
+
+static char *staged_messages_in_order()
+{
+	cacti_config_t config = {.pool_size = 2, .buffer_sends = 1};
+	actor_id_t sender;
+
+	mu_assert("system not created", actor_system_create_ex(&sender, &sender_role, &config) == 0);
+	actor_system_join(sender);
+
+	mu_assert("messages lost", numbers == MESSAGES);
+	mu_assert("messages out of order", out_of_order == 0);
+	return 0;
+}
+
+static void server_request(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	cacti_request_t *request = data;
+
+	send_reply(request->reply_to, request->nbytes + 1, NULL);
+}
+
+static act_t server_prompts[] = {receiver_hello, server_request};
+static role_t server_role = {2, server_prompts, 0};
+
+// The request is staged, it has to go out before the handler blocks.
+static void client_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	actor_id_t server;
+	message_t request = {MSG_REQUEST, 41, NULL};
+	message_t godie = {MSG_GODIE, 0, NULL};
+	message_t reply;
+
+	spawn_actors(&server_role, 1, &server);
+	wait_result = wait_for_reply(send_request_future(server, request), &reply);
+	replied_nbytes = reply.nbytes;
+
+	send_message(server, godie);
+	send_message(actor_id_self(), godie);
+}
+
+static act_t client_prompts[] = {client_hello};
+static role_t client_role = {1, client_prompts, 0};
+
+static char *flushed_before_waiting()
+{
+	cacti_config_t config = {.pool_size = 2, .buffer_sends = 1};
+	actor_id_t client;
+
+	mu_assert("system not created", actor_system_create_ex(&client, &client_role, &config) == 0);
+	actor_system_join(client);
+
+	mu_assert("reply not waited for", wait_result == 0);
+	mu_assert("wrong reply received", replied_nbytes == 42);
+	return 0;
+}
+
+static actor_id_t busy_receiver, flag_setter;
+static atomic_bool is_staged, is_flag_set;
+
+// Returns once the number for him is staged, so a place taken then would keep him spinning for it.
+static void busy_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+
+	while (!atomic_load(&is_staged))
+		sched_yield();
+}
+
+static act_t busy_prompts[] = {busy_hello, receiver_number};
+static role_t busy_role = {2, busy_prompts, 0};
+
+static void setter_flag(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+
+	atomic_store(&is_flag_set, true);
+}
+
+static act_t setter_prompts[] = {receiver_hello, setter_flag};
+static role_t setter_role = {2, setter_prompts, 0};
+
+// Stages a number, then waits for the flag, which needs the other thread.
+static void waiting_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	message_t number = {MSG_NUMBER, 0, NULL};
+	message_t godie = {MSG_GODIE, 0, NULL};
+
+	spawn_actors(&setter_role, 1, &flag_setter);
+	spawn_actors(&busy_role, 1, &busy_receiver);
+	send_message(busy_receiver, number);
+	atomic_store(&is_staged, true);
+	while (!atomic_load(&is_flag_set))
+		sched_yield();
+
+	send_message(busy_receiver, godie);
+	send_message(flag_setter, godie);
+	send_message(actor_id_self(), godie);
+}
+
+static act_t waiting_prompts[] = {waiting_hello};
+static role_t waiting_role = {1, waiting_prompts, 0};
+
+static char *staged_message_holds_back_nobody()
+{
+	cacti_config_t config = {.pool_size = 2, .buffer_sends = 1};
+	actor_id_t sender;
+	message_t flag = {MSG_FLAG, 0, NULL};
+
+	numbers = out_of_order = 0;
+
+	mu_assert("system not created", actor_system_create_ex(&sender, &waiting_role, &config) == 0);
+	while (!atomic_load(&is_staged))
+		sched_yield();
+	mu_assert("flag not sent", send_message(flag_setter, flag) == 0);
+	actor_system_join(sender);
+
+	mu_assert("flag not received", is_flag_set);
+	mu_assert("staged message lost", numbers == 1);
+	return 0;
+}
+
+static char *all_tests()
+{
+	mu_run_test(staged_messages_in_order);
+	mu_run_test(flushed_before_waiting);
+	mu_run_test(staged_message_holds_back_nobody);
+	return 0;
+}
+
+int main()
+{
+	char *result = all_tests();
+	if (result != 0)
+	{
+		printf(__FILE__ ": %s\n", result);
+	}
+	else
+	{
+		printf(__FILE__ ": ALL TESTS PASSED\n");
+	}
+	printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+	return result != 0;
+}
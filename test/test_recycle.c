@@ -0,0 +1,229 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// Places of dead actors are taken by new actors, old ids of a place are rejected.
+
+#define ROUNDS 100
+#define GROUP_ROUNDS 20
+#define GROUP_SIZE 8
+
+#define MSG_BORN (message_type_t)0x1
+#define MSG_POLL (message_type_t)0x2
+#define MSG_WORK (message_type_t)0x1
+
+int tests_run = 0;
+
+static actor_id_t parent, children[ROUNDS];
+static int rounds, stale_sends_accepted;
+
+static void child_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	message_t born = {MSG_BORN, (size_t) actor_id_self(), NULL};
+
+	send_message(*(actor_id_t *) data, born);
+}
+
+static void child_work(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+}
+
+static act_t child_prompts[] = {child_hello, child_work};
+static role_t child_role = {2, child_prompts, 0};
+
+static void spawn_child()
+{
+	message_t spawn = {MSG_SPAWN, sizeof(role_t), &child_role};
+
+	send_message(parent, spawn);
+}
+
+static void parent_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+
+	parent = actor_id_self();
+	spawn_child();
+}
+
+// Kills the new child and waits until his place is free.
+static void parent_born(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) data;
+	message_t godie = {MSG_GODIE, 0, NULL};
+	message_t poll = {MSG_POLL, 0, NULL};
+
+	children[rounds] = (actor_id_t) nbytes;
+	send_message(children[rounds], godie);
+	send_message(parent, poll);
+}
+
+static void parent_poll(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	cacti_actor_stats_t stats;
+	message_t work = {MSG_WORK, 0, NULL};
+	message_t poll = {MSG_POLL, 0, NULL};
+	message_t godie = {MSG_GODIE, 0, NULL};
+
+	// Stats are given only while the id is of the actor using the place.
+	if (cacti_get_actor_stats(children[rounds], &stats) == 0) {
+		send_message(parent, poll);
+		return;
+	}
+
+	for (int i = 0; i <= rounds; i++)
+		if (send_message(children[i], work) != -1)
+			stale_sends_accepted++;
+
+	if (++rounds < ROUNDS)
+		spawn_child();
+	else
+		send_message(parent, godie);
+}
+
+static act_t parent_prompts[] = {parent_hello, parent_born, parent_poll};
+static role_t parent_role = {3, parent_prompts, 0};
+
+static char *recycled_places()
+{
+	// Only one place for children, spawning would fail if it was not freed.
+	cacti_config_t config = {.pool_size = 2, .cast_limit = 2};
+	actor_id_t first;
+	bool is_same_place = true, is_new_id = true;
+
+	mu_assert("system not created", actor_system_create_ex(&first, &parent_role, &config) == 0);
+	actor_system_join(first);
+
+	for (int i = 1; i < ROUNDS; i++) {
+		is_same_place &= ((unsigned long) children[i] & 0xffffffff) == ((unsigned long) children[0] & 0xffffffff);
+		is_new_id &= children[i] != children[i - 1];
+	}
+
+	mu_assert("not all rounds done", rounds == ROUNDS);
+	mu_assert("place not reused", is_same_place);
+	mu_assert("id of a reused place not changed", is_new_id);
+	mu_assert("message to a stale id accepted", stale_sends_accepted == 0);
+	return 0;
+}
+
+static actor_id_t group[GROUP_SIZE];
+static int group_rounds, born_in_group, short_groups;
+
+// Spawns the next group, the test ends at once if it does not fit.
+static void spawn_group()
+{
+	message_t godie = {MSG_GODIE, 0, NULL};
+	long spawned = spawn_actors(&child_role, GROUP_SIZE, group);
+
+	if (spawned == GROUP_SIZE)
+		return;
+
+	short_groups++;
+	for (long i = 0; i < spawned; i++)
+		send_message(group[i], godie);
+	send_message(parent, godie);
+}
+
+static void group_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+
+	parent = actor_id_self();
+	spawn_group();
+}
+
+// Kills the group when all of it is born and waits until the places are free.
+static void group_born(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	message_t godie = {MSG_GODIE, 0, NULL};
+	message_t poll = {MSG_POLL, 0, NULL};
+
+	if (++born_in_group < GROUP_SIZE)
+		return;
+
+	born_in_group = 0;
+	for (int i = 0; i < GROUP_SIZE; i++)
+		send_message(group[i], godie);
+	send_message(parent, poll);
+}
+
+static void group_poll(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	cacti_actor_stats_t stats;
+	message_t poll = {MSG_POLL, 0, NULL};
+	message_t godie = {MSG_GODIE, 0, NULL};
+
+	for (int i = 0; i < GROUP_SIZE; i++) {
+		if (cacti_get_actor_stats(group[i], &stats) == 0) {
+			send_message(parent, poll);
+			return;
+		}
+	}
+
+	if (++group_rounds == GROUP_ROUNDS) {
+		send_message(parent, godie);
+		return;
+	}
+	spawn_group();
+}
+
+static act_t group_prompts[] = {group_hello, group_born, group_poll};
+static role_t group_role = {3, group_prompts, 0};
+
+static char *recycled_places_of_groups()
+{
+	// Places for one group and a half, spawning groups would stop if they were not reused.
+	cacti_config_t config = {.pool_size = 2, .cast_limit = 1 + GROUP_SIZE * 3 / 2};
+	actor_id_t first;
+
+	mu_assert("system not created", actor_system_create_ex(&first, &group_role, &config) == 0);
+	actor_system_join(first);
+
+	mu_assert("not all rounds done", group_rounds == GROUP_ROUNDS);
+	mu_assert("group spawned only in part", short_groups == 0);
+	return 0;
+}
+
+static char *all_tests()
+{
+	mu_run_test(recycled_places);
+	mu_run_test(recycled_places_of_groups);
+	return 0;
+}
+
+int main()
+{
+	char *result = all_tests();
+	if (result != 0)
+	{
+		printf(__FILE__ ": %s\n", result);
+	}
+	else
+	{
+		printf(__FILE__ ": ALL TESTS PASSED\n");
+	}
+	printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+	return result != 0;
+}
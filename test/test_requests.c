@@ -0,0 +1,126 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdio.h>
+
+// Replies come back as messages or through wait_for_reply, a request is replied only once.
+
+#define MSG_REQUEST (message_type_t)0x1
+#define MSG_REPLY (message_type_t)0x1
+
+int tests_run = 0;
+
+static actor_id_t server;
+static int first_reply, second_reply, replies;
+static size_t replied_nbytes;
+
+static void server_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+}
+
+// Replies with twice the nbytes of the request, then tries to reply again.
+static void server_request(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	cacti_request_t *request = data;
+	request_id_t reply_to = request->reply_to;
+
+	first_reply = send_reply(reply_to, request->nbytes * 2, NULL);
+	second_reply = send_reply(reply_to, request->nbytes * 3, NULL);
+}
+
+static act_t server_prompts[] = {server_hello, server_request};
+static role_t server_role = {2, server_prompts, 0};
+
+static void client_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	message_t request = {MSG_REQUEST, 21, NULL};
+
+	spawn_actors(&server_role, 1, &server);
+	send_request(server, request, MSG_REPLY);
+}
+
+static void client_reply(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) data;
+	message_t godie = {MSG_GODIE, 0, NULL};
+
+	replies++;
+	replied_nbytes = nbytes;
+	send_message(server, godie);
+	send_message(actor_id_self(), godie);
+}
+
+static act_t client_prompts[] = {client_hello, client_reply};
+static role_t client_role = {2, client_prompts, 0};
+
+static char *reply_as_message()
+{
+	actor_id_t client;
+
+	first_reply = second_reply = -2;
+	replies = 0;
+
+	mu_assert("system not created", actor_system_create(&client, &client_role) == 0);
+	actor_system_join(client);
+
+	mu_assert("reply not sent", first_reply == 0);
+	mu_assert("second reply accepted", second_reply == -1);
+	mu_assert("not one reply received", replies == 1);
+	mu_assert("wrong reply received", replied_nbytes == 42);
+	return 0;
+}
+
+static char *reply_waited_for()
+{
+	actor_id_t actor;
+	request_id_t request;
+	message_t request_message = {MSG_REQUEST, 5, NULL};
+	message_t godie = {MSG_GODIE, 0, NULL};
+	message_t reply;
+
+	first_reply = second_reply = -2;
+
+	mu_assert("system not created", actor_system_create(&actor, &server_role) == 0);
+	request = send_request_future(actor, request_message);
+	mu_assert("request not sent", request >= 0);
+	mu_assert("reply not waited for", wait_for_reply(request, &reply) == 0);
+	send_message(actor, godie);
+	actor_system_join(actor);
+
+	mu_assert("wrong reply received", reply.nbytes == 10);
+	mu_assert("reply not sent", first_reply == 0);
+	mu_assert("second reply accepted", second_reply == -1);
+	return 0;
+}
+
+static char *all_tests()
+{
+	mu_run_test(reply_as_message);
+	mu_run_test(reply_waited_for);
+	return 0;
+}
+
+int main()
+{
+	char *result = all_tests();
+	if (result != 0)
+	{
+		printf(__FILE__ ": %s\n", result);
+	}
+	else
+	{
+		printf(__FILE__ ": ALL TESTS PASSED\n");
+	}
+	printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+	return result != 0;
+}
@@ -0,0 +1,235 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Routers spread messages by their strategies, a router dies with its members and its place is reused.
+
+#define MEMBERS 4
+#define MESSAGES 400
+#define KEYS 16
+#define ROUNDS 20
+
+#define MSG_WORK (message_type_t)0x1
+#define MSG_DONE (message_type_t)0x1
+#define MSG_POLL (message_type_t)0x1
+
+int tests_run = 0;
+
+static actor_id_t parent;
+static actor_id_t members[3][MEMBERS], routers[3];
+static atomic_long received[3][MEMBERS], key_owners[KEYS], total, wrong_owners;
+static bool is_spawn_short;
+
+static void member_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+}
+
+// Nbytes of work is the strategy times KEYS plus the key.
+static void member_work(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) data;
+	int strategy = (int) (nbytes / KEYS), key = (int) (nbytes % KEYS);
+	long owner = -1;
+	message_t done = {MSG_DONE, 0, NULL};
+
+	for (int i = 0; i < MEMBERS; i++) {
+		if (members[strategy][i] != actor_id_self())
+			continue;
+
+		atomic_fetch_add(&received[strategy][i], 1);
+		if (strategy == ROUTER_CONSISTENT_HASH &&
+		    !atomic_compare_exchange_strong(&key_owners[key], &owner, i) && owner != i)
+			atomic_fetch_add(&wrong_owners, 1);
+	}
+
+	if (atomic_fetch_add(&total, 1) + 1 == 3 * MESSAGES)
+		send_message(parent, done);
+}
+
+static act_t member_prompts[] = {member_hello, member_work};
+static role_t member_role = {2, member_prompts, 0};
+
+static void parent_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	message_t godie = {MSG_GODIE, 0, NULL};
+	long spawned;
+
+	parent = actor_id_self();
+	for (int strategy = 0; strategy < 3; strategy++) {
+		spawned = spawn_router(&member_role, MEMBERS, (router_strategy_t) strategy, members[strategy],
+		                       &routers[strategy]);
+		// The test ends at once if a router does not fit, with all members spawned so far.
+		if (spawned != MEMBERS) {
+			is_spawn_short = true;
+			for (int i = 0; i < strategy; i++)
+				broadcast_message(members[i], MEMBERS, godie, NULL);
+			if (spawned > 0)
+				broadcast_message(members[strategy], (size_t) spawned, godie, NULL);
+			send_message(parent, godie);
+			return;
+		}
+	}
+
+	for (int i = 0; i < MESSAGES; i++) {
+		for (int strategy = 0; strategy < 3; strategy++) {
+			message_t work = {MSG_WORK, (size_t) (strategy * KEYS + i % KEYS), NULL};
+			if (strategy == ROUTER_CONSISTENT_HASH)
+				send_message_with_key(routers[strategy], work, (unsigned long) (i % KEYS));
+			else
+				send_message(routers[strategy], work);
+		}
+	}
+}
+
+static void parent_done(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	message_t godie = {MSG_GODIE, 0, NULL};
+
+	for (int strategy = 0; strategy < 3; strategy++)
+		broadcast_message(members[strategy], MEMBERS, godie, NULL);
+	send_message(parent, godie);
+}
+
+static act_t parent_prompts[] = {parent_hello, parent_done};
+static role_t parent_role = {2, parent_prompts, 0};
+
+static char *strategies()
+{
+	cacti_config_t config = {.pool_size = 2};
+	actor_id_t first;
+	int used_for_keys = 0;
+	long least_loaded = 0;
+	bool is_round_robin = true;
+
+	for (int i = 0; i < KEYS; i++)
+		key_owners[i] = -1;
+
+	mu_assert("system not created", actor_system_create_ex(&first, &parent_role, &config) == 0);
+	actor_system_join(first);
+
+	mu_assert("router spawned only in part", !is_spawn_short);
+	mu_assert("messages lost", total == 3 * MESSAGES);
+	for (int i = 0; i < MEMBERS; i++) {
+		is_round_robin &= (received[ROUTER_ROUND_ROBIN][i] == MESSAGES / MEMBERS);
+		used_for_keys += (received[ROUTER_CONSISTENT_HASH][i] > 0);
+		least_loaded += received[ROUTER_LEAST_LOADED][i];
+	}
+	mu_assert("members not taken in turn", is_round_robin);
+	mu_assert("key sent to different members", wrong_owners == 0);
+	mu_assert("keys not spread", used_for_keys > 1);
+	mu_assert("least loaded router missed members", least_loaded == MESSAGES);
+	return 0;
+}
+
+static actor_id_t round_members[MEMBERS], round_router;
+static int rounds, short_routers, stale_sends_accepted;
+
+// Spawns the next router, the test ends at once if it does not fit.
+static void spawn_round()
+{
+	message_t godie = {MSG_GODIE, 0, NULL};
+	message_t poll = {MSG_POLL, 0, NULL};
+	long spawned = spawn_router(&member_role, MEMBERS, ROUTER_ROUND_ROBIN, round_members, &round_router);
+
+	if (spawned != MEMBERS) {
+		short_routers++;
+		if (spawned > 0)
+			broadcast_message(round_members, (size_t) spawned, godie, NULL);
+		send_message(parent, godie);
+		return;
+	}
+
+	broadcast_message(round_members, MEMBERS, godie, NULL);
+	send_message(parent, poll);
+}
+
+static void round_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+
+	parent = actor_id_self();
+	spawn_round();
+}
+
+// Waits until the members are reclaimed, the router with them.
+static void round_poll(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	cacti_actor_stats_t stats;
+	message_t poll = {MSG_POLL, 0, NULL};
+	message_t work = {MSG_WORK, 0, NULL};
+	message_t godie = {MSG_GODIE, 0, NULL};
+
+	for (int i = 0; i < MEMBERS; i++) {
+		if (cacti_get_actor_stats(round_members[i], &stats) == 0) {
+			send_message(parent, poll);
+			return;
+		}
+	}
+
+	if (send_message(round_router, work) != -1)
+		stale_sends_accepted++;
+
+	if (++rounds == ROUNDS)
+		send_message(parent, godie);
+	else
+		spawn_round();
+}
+
+static act_t round_prompts[] = {round_hello, round_poll};
+static role_t round_role = {2, round_prompts, 0};
+
+static char *reused_places()
+{
+	// Places for the parent and one router, more routers fit only if places are reused.
+	cacti_config_t config = {.pool_size = 2, .cast_limit = 2 + MEMBERS};
+	actor_id_t first;
+
+	mu_assert("system not created", actor_system_create_ex(&first, &round_role, &config) == 0);
+	actor_system_join(first);
+
+	mu_assert("not all rounds done", rounds == ROUNDS);
+	mu_assert("router spawned only in part", short_routers == 0);
+	mu_assert("message to a dead router accepted", stale_sends_accepted == 0);
+	return 0;
+}
+
+static char *all_tests()
+{
+	mu_run_test(strategies);
+	mu_run_test(reused_places);
+	return 0;
+}
+
+int main()
+{
+	char *result = all_tests();
+	if (result != 0)
+	{
+		printf(__FILE__ ": %s\n", result);
+	}
+	else
+	{
+		printf(__FILE__ ": ALL TESTS PASSED\n");
+	}
+	printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+	return result != 0;
+}
@@ -0,0 +1,191 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A shared broadcast allocates only the payload once warmed up, the last
+ * reference frees it. Allocations are counted by wrappers, see CMakeLists.txt.
+ */
+
+#define NUMBER_OF_ACTORS 1000
+#define ROUNDS 4
+#define PAYLOAD_SIZE (1024 * 1024)
+
+#define MSG_WORK (message_type_t)0x1
+#define MSG_DONE (message_type_t)0x1
+
+int tests_run = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__real_aligned_alloc(size_t alignment, size_t size);
+void __real_free(void *ptr);
+
+static _Thread_local bool is_counting;
+static _Thread_local long allocations;
+static void *payload_block;
+static bool is_payload_freed;
+
+void *__wrap_malloc(size_t size)
+{
+	void *block = __real_malloc(size);
+
+	allocations += is_counting;
+	// The only block this large is the payload.
+	if (size >= PAYLOAD_SIZE) {
+		payload_block = block;
+		is_payload_freed = false;
+	}
+	return block;
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+	allocations += is_counting;
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	allocations += is_counting;
+	return __real_realloc(ptr, size);
+}
+
+void *__wrap_aligned_alloc(size_t alignment, size_t size)
+{
+	allocations += is_counting;
+	return __real_aligned_alloc(alignment, size);
+}
+
+void __wrap_free(void *ptr)
+{
+	if (ptr != NULL && ptr == payload_block)
+		is_payload_freed = true;
+	__real_free(ptr);
+}
+
+static actor_id_t sender, receivers[NUMBER_OF_ACTORS];
+static long number_of_done, rounds, round_allocations[ROUNDS], freed_early;
+static bool is_freed_after_round[ROUNDS];
+
+static void receiver_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+}
+
+static void receiver_work(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	message_t done = {MSG_DONE, 0, NULL};
+
+	if (is_payload_freed)
+		freed_early++;
+	send_message(sender, done);
+}
+
+static act_t receiver_prompts[] = {receiver_hello, receiver_work};
+static role_t receiver_role = {2, receiver_prompts, 0};
+
+// Counts allocations of a round, from allocating the payload to giving up the sender`s reference.
+static void send_round()
+{
+	void *data;
+	message_t work = {MSG_WORK, PAYLOAD_SIZE, NULL};
+
+	is_counting = true;
+	allocations = 0;
+	data = cacti_alloc_shared(PAYLOAD_SIZE);
+	work.data = data;
+	memset(data, (int) rounds, PAYLOAD_SIZE);
+	broadcast_message_shared(receivers, NUMBER_OF_ACTORS, work, NULL);
+	cacti_free_shared(data);
+	is_counting = false;
+
+	round_allocations[rounds++] = allocations;
+}
+
+static void sender_hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+
+	sender = actor_id_self();
+	spawn_actors(&receiver_role, NUMBER_OF_ACTORS, receivers);
+	send_round();
+}
+
+static void sender_done(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	message_t godie = {MSG_GODIE, 0, NULL};
+
+	if (++number_of_done % NUMBER_OF_ACTORS != 0)
+		return;
+
+	// With one thread the last receiver has dropped his reference by now.
+	is_freed_after_round[rounds - 1] = is_payload_freed;
+
+	if (rounds < ROUNDS) {
+		send_round();
+		return;
+	}
+
+	broadcast_message(receivers, NUMBER_OF_ACTORS, godie, NULL);
+	send_message(sender, godie);
+}
+
+static act_t sender_prompts[] = {sender_hello, sender_done};
+static role_t sender_role = {2, sender_prompts, 0};
+
+static char *one_allocation_per_broadcast()
+{
+	cacti_config_t config = {.pool_size = 1};
+	actor_id_t first;
+	bool is_freed = true;
+
+	mu_assert("system not created", actor_system_create_ex(&first, &sender_role, &config) == 0);
+	actor_system_join(first);
+
+	mu_assert("not all rounds done", rounds == ROUNDS);
+	// The first round warms up nodes and vectors of the thread.
+	for (int i = 1; i < ROUNDS; i++)
+		mu_assert("broadcast allocated more than the payload", round_allocations[i] == 1);
+	for (int i = 0; i < ROUNDS; i++)
+		is_freed &= is_freed_after_round[i];
+	mu_assert("payload freed while referenced", freed_early == 0);
+	mu_assert("payload not freed by the last reference", is_freed);
+	return 0;
+}
+
+static char *all_tests()
+{
+	mu_run_test(one_allocation_per_broadcast);
+	return 0;
+}
+
+int main()
+{
+	char *result = all_tests();
+	if (result != 0)
+	{
+		printf(__FILE__ ": %s\n", result);
+	}
+	else
+	{
+		printf(__FILE__ ": ALL TESTS PASSED\n");
+	}
+	printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+	return result != 0;
+}
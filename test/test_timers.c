@@ -0,0 +1,151 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+// One-shot timers fire once after their delay, periodic ones until cancelled, cancelled ones never.
+
+#define ONCE_US 20000
+#define PERIOD_US 2000
+#define END_US 20000
+#define MIN_TICKS 3
+
+#define MSG_ONCE (message_type_t)0x1
+#define MSG_TICK (message_type_t)0x2
+#define MSG_CANCELLED (message_type_t)0x3
+#define MSG_END (message_type_t)0x4
+
+int tests_run = 0;
+
+static timer_id_t once, periodic;
+static int onces, ticks, cancelled_fired, ticks_at_cancel, ticks_at_end;
+static int first_cancel, second_cancel, fired_cancel, periodic_cancel;
+static unsigned long once_after_us;
+static struct timespec start;
+
+static unsigned long elapsed_us()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long) ((now.tv_sec - start.tv_sec) * 1000000 + (now.tv_nsec - start.tv_nsec) / 1000);
+}
+
+static void hello(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	message_t once_message = {MSG_ONCE, 0, NULL};
+	message_t tick = {MSG_TICK, 0, NULL};
+	message_t cancelled = {MSG_CANCELLED, 0, NULL};
+	timer_id_t timer;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	once = send_message_after(actor_id_self(), once_message, ONCE_US);
+	periodic = send_message_every(actor_id_self(), tick, PERIOD_US, PERIOD_US);
+
+	timer = send_message_after(actor_id_self(), cancelled, PERIOD_US);
+	first_cancel = cancel_timer(timer);
+	second_cancel = cancel_timer(timer);
+}
+
+// Waits for enough ticks, then cancels the periodic timer and waits a while longer.
+static void once_fired(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	message_t once_message = {MSG_ONCE, 0, NULL};
+	message_t end = {MSG_END, 0, NULL};
+
+	if (onces++ == 0) {
+		once_after_us = elapsed_us();
+		fired_cancel = cancel_timer(once);
+	}
+
+	if (ticks < MIN_TICKS) {
+		send_message_after(actor_id_self(), once_message, PERIOD_US);
+		return;
+	}
+
+	periodic_cancel = cancel_timer(periodic);
+	ticks_at_cancel = ticks;
+	send_message_after(actor_id_self(), end, END_US);
+}
+
+static void tick(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+
+	ticks++;
+}
+
+static void cancelled_timer_fired(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+
+	cancelled_fired++;
+}
+
+static void end(void **stateptr, size_t nbytes, void *data)
+{
+	(void) stateptr;
+	(void) nbytes;
+	(void) data;
+	message_t godie = {MSG_GODIE, 0, NULL};
+
+	ticks_at_end = ticks;
+	send_message(actor_id_self(), godie);
+}
+
+static act_t prompts[] = {hello, once_fired, tick, cancelled_timer_fired, end};
+static role_t role = {5, prompts, 0};
+
+static char *timers_fire_and_cancel()
+{
+	actor_id_t actor;
+
+	mu_assert("system not created", actor_system_create(&actor, &role) == 0);
+	actor_system_join(actor);
+
+	mu_assert("timer id not given", once >= 0 && periodic >= 0);
+	mu_assert("one-shot timer fired early", once_after_us >= ONCE_US);
+	mu_assert("fired one-shot timer cancelled", fired_cancel == -1);
+	mu_assert("pending timer not cancelled", first_cancel == 0);
+	mu_assert("timer cancelled twice", second_cancel == -1);
+	mu_assert("cancelled timer fired", cancelled_fired == 0);
+	mu_assert("periodic timer not repeated", ticks_at_cancel >= MIN_TICKS);
+	mu_assert("periodic timer not cancelled", periodic_cancel == 0);
+	// A tick sent just before the cancel can still be waiting in the queue.
+	mu_assert("cancelled periodic timer fired", ticks_at_end - ticks_at_cancel <= 1);
+	return 0;
+}
+
+static char *all_tests()
+{
+	mu_run_test(timers_fire_and_cancel);
+	return 0;
+}
+
+int main()
+{
+	char *result = all_tests();
+	if (result != 0)
+	{
+		printf(__FILE__ ": %s\n", result);
+	}
+	else
+	{
+		printf(__FILE__ ": ALL TESTS PASSED\n");
+	}
+	printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+	return result != 0;
+}